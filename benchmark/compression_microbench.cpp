@@ -0,0 +1,98 @@
+#include "../shard_node/kvstore.hpp"
+#include "../shard_node/value_codec.hpp"
+#include "../shard_node/wal.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+// Memory, WAL and snapshot bytes per key for multi-KB JSON values under
+// each codec, with what compressing costs a put and decompressing a get.
+// Codecs this build lacks are skipped.
+class CompressionMicrobench {
+private:
+    // JSON records of about `bytes`, varying by key as real documents do
+    static std::string jsonValue(size_t bytes, size_t seed) {
+        std::string value = "[";
+        for (size_t i = 0; value.size() < bytes; ++i) {
+            size_t id = seed * 1000 + i;
+            value += "{\"id\":" + std::to_string(id) + ",\"user\":\"user_" + std::to_string(id * 7919 % 100000) +
+                     "\",\"active\":" + (id % 3 ? "true" : "false") + ",\"score\":" + std::to_string(id * 31 % 1000) +
+                     ",\"tags\":[\"t" + std::to_string(id % 17) + "\",\"t" + std::to_string(id % 23) + "\"]},";
+        }
+        value.back() = ']';
+        return value;
+    }
+
+    static double elapsedNs(std::chrono::steady_clock::time_point since, size_t ops) {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - since).count() / ops;
+    }
+
+    static size_t fileBytes(const std::string& log) {
+        size_t bytes = 0;
+        for (const auto& segment : WriteAheadLog::listSegments(log)) bytes += std::filesystem::file_size(segment);
+        return bytes;
+    }
+
+public:
+    void benchmark(ValueCompression codec, size_t keys, size_t valueSize) {
+        std::cout << std::left << std::setw(6) << ValueCodec::name(codec);
+        if (!ValueCodec::isAvailable(codec)) {
+            std::cout << "not built in" << std::endl;
+            return;
+        }
+        const std::string log = "compression_bench.log";
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.deltaSnapshotsPerFull = 0;
+            options.valueCompression = codec;
+            // So the segment files measure what was written
+            options.wal.preallocate = false;
+            auto store = KVStore::create(log, options);
+            std::vector<std::string> values;
+            values.reserve(keys);
+            for (size_t i = 0; i < keys; ++i) values.push_back(jsonValue(valueSize, i));
+
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < keys; ++i) {
+                // The last put waits for every record to reach the file
+                store->put("key_" + std::to_string(i), values[i], i + 1 < keys ? Durability::None : Durability::Flush);
+            }
+            double putNs = elapsedNs(start, keys);
+            size_t wal = fileBytes(log);
+
+            size_t found = 0;
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < keys; ++i) found += store->get("key_" + std::to_string(i)).has_value();
+            double getNs = elapsedNs(start, keys);
+
+            store->runSnapshot();
+            size_t memory = store->getMemoryStats().bytesUsed;
+            size_t snapshot = std::filesystem::file_size(log + ".snapshot");
+            auto stats = store->getCompressionStats();
+            std::cout << std::fixed << std::setprecision(0) << std::right << std::setw(7) << memory / keys
+                      << " B/key in memory, " << std::setw(7) << wal / keys << " in the WAL, " << std::setw(7)
+                      << snapshot / keys << " in the snapshot, " << std::setprecision(2) << stats.ratio
+                      << "x, put " << std::setprecision(0) << putNs << " ns, get " << getNs << " ns"
+                      << (found == keys ? "" : " (missing keys)") << std::endl;
+        }
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+    }
+};
+
+int main() {
+    CompressionMicrobench bench;
+    for (size_t valueSize : {2048, 8192, 32768}) {
+        std::cout << "\n=== " << (valueSize >> 10) << " KiB JSON values, 20000 keys ===" << std::endl;
+        for (ValueCompression codec : {ValueCompression::None, ValueCompression::LZ4, ValueCompression::Zstd}) {
+            bench.benchmark(codec, 20000, valueSize);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "../shard_node/kvstore.hpp"
+#include "../shard_node/wal.hpp"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Throughput of one KVStore as writer threads are added, all writing random
+// keys of the same store. With or without its WAL, so lock contention in
+// the map can be told apart from the log's. Then the same for read-mostly
+// mixes, where gets take no lock and should scale with the threads, and
+// read-only runs with LRU or LFU eviction on, where gets also write the
+// access word, over all keys and over a few hot ones.
+class ContentionMicrobench {
+private:
+    static constexpr size_t KEYS = 1000000;
+
+    static constexpr size_t HOT_KEYS = 100;
+
+    // `writePercent` of the operations are puts, the rest gets, all on the
+    // first `keys` keys
+    static double run(KVStore& store, size_t threads, std::chrono::milliseconds duration,
+                      unsigned writePercent = 100, size_t keys = KEYS) {
+        std::atomic<bool> start{false}, stop{false};
+        std::atomic<uint64_t> total{0};
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937_64 random(t);
+                std::string value(50, 'v');
+                uint64_t ops = 0;
+                while (!start) std::this_thread::yield();
+                while (!stop) {
+                    uint64_t r = random();
+                    std::string key = "key_" + std::to_string(r % keys);
+                    if ((r >> 32) % 100 < writePercent) {
+                        store.put(key, value);
+                    } else {
+                        store.get(key);
+                    }
+                    ++ops;
+                }
+                total += ops;
+            });
+        }
+        auto begin = std::chrono::steady_clock::now();
+        start = true;
+        std::this_thread::sleep_for(duration);
+        stop = true;
+        for (auto& worker : workers) worker.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return total / seconds / 1e6;
+    }
+
+public:
+    void benchmark(bool withWAL, const std::vector<size_t>& threadCounts) {
+        std::cout << "\n=== Concurrent puts, " << (withWAL ? "with WAL" : "in memory") << " ===" << std::endl;
+        const std::string log = "contention_bench.log";
+        WriteAheadLog::removeLog(log);
+        {
+            std::unique_ptr<KVStore> store;
+            if (withWAL) {
+                KVStoreOptions options;
+                options.backgroundThreads = false;
+                options.deltaSnapshotsPerFull = 0;
+                store = KVStore::create(log, options);
+            } else {
+                store = std::make_unique<KVStore>();
+            }
+            std::string value(50, 'v');
+            for (size_t i = 0; i < KEYS; ++i) {
+                store->put("key_" + std::to_string(i), value);
+            }
+
+            std::cout << std::fixed << std::setprecision(2);
+            for (size_t threads : threadCounts) {
+                double mops = run(*store, threads, std::chrono::milliseconds(1000));
+                std::cout << std::right << std::setw(3) << threads << " threads: "
+                          << mops << " Mops/s" << std::endl;
+            }
+        }
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+    }
+
+    void benchmarkReads(unsigned writePercent, const std::vector<size_t>& threadCounts) {
+        std::cout << "\n=== Concurrent gets, " << writePercent << "% puts, in memory ===" << std::endl;
+        KVStore store;
+        std::string value(50, 'v');
+        for (size_t i = 0; i < KEYS; ++i) {
+            store.put("key_" + std::to_string(i), value);
+        }
+
+        std::cout << std::fixed << std::setprecision(2);
+        for (size_t threads : threadCounts) {
+            double mops = run(store, threads, std::chrono::milliseconds(1000), writePercent);
+            std::cout << std::right << std::setw(3) << threads << " threads: "
+                      << mops << " Mops/s" << std::endl;
+        }
+    }
+
+    void benchmarkEviction(EvictionPolicy policy, const std::vector<size_t>& threadCounts) {
+        const std::string log = "contention_bench.log";
+        WriteAheadLog::removeLog(log);
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.deltaSnapshotsPerFull = 0;
+            // Enough that nothing is evicted; entries still carry an access word
+            options.maxMemoryBytes = size_t(1) << 32;
+            options.evictionPolicy = policy;
+            auto store = KVStore::create(log, options);
+            std::string value(50, 'v');
+            for (size_t i = 0; i < KEYS; ++i) {
+                store->put("key_" + std::to_string(i), value);
+            }
+
+            for (size_t keys : {KEYS, HOT_KEYS}) {
+                std::cout << "\n=== Concurrent gets of " << keys << " keys, "
+                          << (policy == EvictionPolicy::LRU ? "LRU" : "LFU") << " eviction on ===" << std::endl;
+                std::cout << std::fixed << std::setprecision(2);
+                for (size_t threads : threadCounts) {
+                    double mops = run(*store, threads, std::chrono::milliseconds(1000), 0, keys);
+                    std::cout << std::right << std::setw(3) << threads << " threads: "
+                              << mops << " Mops/s" << std::endl;
+                }
+            }
+        }
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+    }
+};
+
+int main() {
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    std::vector<size_t> threadCounts{1, 2, 4, 8, 16, 32, 48, 64};
+    ContentionMicrobench bench;
+    bench.benchmark(false, threadCounts);
+    bench.benchmark(true, threadCounts);
+    bench.benchmarkReads(0, threadCounts);
+    bench.benchmarkReads(5, threadCounts);
+    bench.benchmarkEviction(EvictionPolicy::LRU, threadCounts);
+    bench.benchmarkEviction(EvictionPolicy::LFU, threadCounts);
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include "../shard_node/kvstore.hpp"
+#include "../shard_node/wal.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures one TTL cleanup pass on a large store: with nothing due, and
+// with a slice of the keys due. For sampled expiry, also what a cycle costs
+// and how many expired keys are still held after a minute of cycles. Last,
+// the deadline checks on the read path: gets and a full snapshot of TTL keys.
+class ExpiryMicrobench {
+private:
+    static double elapsedMs(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    static const char* modeName(ExpiryMode mode) {
+        return mode == ExpiryMode::Sampled ? "sampled" : "timing wheel";
+    }
+
+public:
+    void benchmarkReads(size_t entries) {
+        std::cout << "\n=== TTL checks on reads ===" << std::endl;
+        std::cout << "Entries: " << entries << " (all with a TTL)" << std::endl;
+
+        const std::string log = "expiry_bench_reads.log";
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.deltaSnapshotsPerFull = 0;
+            auto store = KVStore::create(log, options);
+            std::vector<std::string> keys;
+            keys.reserve(entries);
+            for (size_t i = 0; i < entries; ++i) {
+                keys.push_back("key_" + std::to_string(i));
+                store->put(keys.back(), "value", 3600 * 1000);
+            }
+
+            std::cout << std::fixed << std::setprecision(2);
+            size_t found = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int round = 0; round < 5; ++round) {
+                for (const auto& key : keys) found += store->get(key).has_value();
+            }
+            double ms = elapsedMs(start);
+            std::cout << std::left << std::setw(16) << "get:" << ms * 1e6 / (5 * entries) << " ns/op"
+                      << (found == 5 * entries ? "" : " (missing keys)") << std::endl;
+
+            start = std::chrono::steady_clock::now();
+            store->runSnapshot();
+            std::cout << std::left << std::setw(16) << "full snapshot:" << elapsedMs(start) << " ms" << std::endl;
+        }
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+    }
+
+    void benchmark(size_t entries, size_t expiring, ExpiryMode mode) {
+        std::cout << "\n=== TTL cleanup pass, " << modeName(mode) << " ===" << std::endl;
+        std::cout << "Entries: " << entries << " (all with a TTL), Expiring: " << expiring << std::endl;
+
+        const std::string log = "expiry_bench.log";
+        WriteAheadLog::removeLog(log);
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.deltaSnapshotsPerFull = 0;
+            options.expiryMode = mode;
+            auto store = KVStore::create(log, options);
+            // The short TTLs go in last so none are due before the first pass
+            for (size_t i = 0; i < entries; ++i) {
+                int ttl_ms = i + expiring >= entries ? 3000 : 3600 * 1000;
+                store->put("key_" + std::to_string(i), "value", ttl_ms);
+            }
+
+            std::cout << std::fixed << std::setprecision(2);
+            auto start = std::chrono::steady_clock::now();
+            store->runCleanup();
+            std::cout << std::left << std::setw(16) << "nothing due:" << elapsedMs(start) << " ms" << std::endl;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(3100));
+            start = std::chrono::steady_clock::now();
+            store->runCleanup();
+            std::cout << std::left << std::setw(16) << "keys due:" << elapsedMs(start) << " ms" << std::endl;
+
+            auto stats = store->getExpiryStats();
+            std::cout << std::left << std::setw(16) << "expired:" << stats.keysExpired << " of " << expiring << std::endl;
+            if (mode == ExpiryMode::Sampled && expiring > 0) {
+                // A minute's worth at the default cleanup interval
+                for (int i = 0; i < 60; ++i) store->runCleanup();
+                stats = store->getExpiryStats();
+                std::cout << std::left << std::setw(16) << "60 cycles:" << stats.keysExpired << " expired, "
+                          << static_cast<double>(stats.cpuTime.count()) / stats.cycles << " us CPU and "
+                          << stats.keysProbed / stats.cycles << " probes per cycle" << std::endl;
+                std::cout << std::left << std::setw(16) << "overhang:" << "~" << stats.expiredKeysEstimate
+                          << " keys, ~" << (stats.expiredBytesEstimate >> 10) << " KiB" << std::endl;
+            }
+        }
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+    }
+};
+
+int main() {
+    ExpiryMicrobench bench;
+    for (ExpiryMode mode : {ExpiryMode::TimingWheel, ExpiryMode::Sampled}) {
+        bench.benchmark(1000000, 0, mode);
+        bench.benchmark(1000000, 100000, mode);
+        bench.benchmark(1000000, 500000, mode);
+    }
+    bench.benchmarkReads(1000000);
+    return 0;
+}
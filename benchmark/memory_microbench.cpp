@@ -0,0 +1,162 @@
+#include "../shard_node/kvstore.hpp"
+#include "../shard_node/wal.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+
+#include <malloc.h>
+#include <unistd.h>
+
+// Memory a KVStore holds per key, for keys of a given size with and without
+// a TTL: heap bytes in use by malloc's own count, plus the entry slabs,
+// which are mapped outside the heap. Then, after most keys are removed,
+// how much of the memory goes back once cleanup compacts the slabs. Last,
+// a store used as a cache under a memory limit: hit rate and cost per
+// operation for each eviction policy.
+class MemoryMicrobench {
+private:
+    static size_t heapInUse() {
+        struct mallinfo2 info = mallinfo2();
+        return info.uordblks + info.hblkhd;
+    }
+
+    static size_t residentBytes() {
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        statm >> pages >> resident;
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    // Fixed-width keys, so every key is exactly key_size bytes
+    static std::string makeKey(size_t i, size_t key_size) {
+        std::string digits = std::to_string(i);
+        return std::string(key_size - digits.size(), 'k') + digits;
+    }
+
+public:
+    void benchmark(size_t entries, size_t key_size, size_t value_size, bool with_ttl) {
+        const std::string log = "memory_bench.log";
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.deltaSnapshotsPerFull = 0;
+            auto store = KVStore::create(log, options);
+            std::string value(value_size, 'v');
+
+            size_t before = heapInUse();
+            for (size_t i = 0; i < entries; ++i) {
+                if (with_ttl) {
+                    store->put(makeKey(i, key_size), value, 3600 * 1000);
+                } else {
+                    store->put(makeKey(i, key_size), value);
+                }
+            }
+            store->runCleanup();
+            double per_key = static_cast<double>(heapInUse() - before + store->getMemoryStats().slabBytes) / entries;
+
+            std::cout << std::left << std::setw(28)
+                      << (std::to_string(key_size) + " B key, " + std::to_string(value_size) + " B value"
+                          + (with_ttl ? ", TTL:" : ":"))
+                      << std::fixed << std::setprecision(1) << per_key << " bytes/key ("
+                      << key_size + value_size << " B payload)" << std::endl;
+        }
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+    }
+
+    void benchmarkChurn(size_t entries, size_t value_size, size_t keep_every) {
+        std::cout << "\n=== Memory after removing most keys ===" << std::endl;
+        std::cout << "Entries: " << entries << ", Value size: " << value_size
+                  << " bytes, Keeping 1 in " << keep_every << std::endl;
+        const std::string log = "memory_bench_churn.log";
+        WriteAheadLog::removeLog(log);
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.deltaSnapshotsPerFull = 0;
+            auto store = KVStore::create(log, options);
+            std::string value(value_size, 'v');
+            malloc_trim(0); // Earlier runs' freed heap would otherwise hide this one's growth
+            size_t baseline = residentBytes();
+            for (size_t i = 0; i < entries; ++i) store->put(makeKey(i, 20), value);
+
+            auto report = [&](const char* name) {
+                auto stats = store->getMemoryStats();
+                std::cout << std::left << std::setw(16) << name << std::fixed << std::setprecision(1)
+                          << (stats.bytesUsed >> 20) << " MiB used, " << (stats.slabBytes >> 20)
+                          << " MiB slabs, " << ((residentBytes() - baseline) >> 20) << " MiB RSS" << std::endl;
+            };
+            report("filled:");
+            for (size_t i = 0; i < entries; ++i) {
+                if (i % keep_every != 0) store->remove(makeKey(i, 20));
+            }
+            store->runCleanup();
+            report("compacted:");
+            auto stats = store->getMemoryStats();
+            std::cout << std::left << std::setw(16) << "moved:" << stats.entriesMoved << " entries in "
+                      << stats.compactions << " compaction(s)" << std::endl;
+        }
+        WriteAheadLog::removeLog(log);
+    }
+
+    // Reads a skewed key stream, putting each key that misses, as a
+    // read-through cache would. One in eight keys is hot and takes most
+    // of the reads.
+    void benchmarkEviction(EvictionPolicy policy, const char* name, size_t keys, size_t limit, size_t ops) {
+        const std::string log = "memory_bench_eviction.log";
+        WriteAheadLog::removeLog(log);
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.deltaSnapshotsPerFull = 0;
+            options.maxMemoryBytes = limit;
+            options.evictionPolicy = policy;
+            auto store = KVStore::create(log, options);
+            std::string value(100, 'v');
+            std::minstd_rand random(42);
+            size_t hits = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < ops; ++i) {
+                size_t key = random() % 10 < 8 ? random() % (keys / 8) : random() % keys;
+                std::string name = makeKey(key, 20);
+                bool ttl = key % 2 == 0;
+                if (store->get(name)) {
+                    ++hits;
+                } else if (ttl) {
+                    store->put(name, value, 3600 * 1000);
+                } else {
+                    store->put(name, value);
+                }
+            }
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ops;
+            auto stats = store->getMemoryStats();
+            std::cout << std::left << std::setw(16) << (std::string(name) + ":") << std::fixed << std::setprecision(1)
+                      << 100.0 * hits / ops << "% hits, " << ns << " ns/op, " << stats.keysEvicted << " evicted, "
+                      << (stats.bytesUsed >> 20) << " MiB used" << std::endl;
+        }
+        WriteAheadLog::removeLog(log);
+    }
+};
+
+int main() {
+    std::cout << "=== KVStore memory per key (1M keys) ===" << std::endl;
+    MemoryMicrobench bench;
+    bench.benchmark(1000000, 20, 50, false);
+    bench.benchmark(1000000, 20, 50, true);
+    bench.benchmark(1000000, 10, 4, false);
+    bench.benchmark(1000000, 32, 200, true);
+    bench.benchmarkChurn(1000000, 100, 10);
+
+    std::cout << "\n=== Cache under a 32 MiB limit ===" << std::endl;
+    std::cout << "Keys: 1000000 (100 B values, half with a TTL), 80% of reads on 1 in 8" << std::endl;
+    bench.benchmarkEviction(EvictionPolicy::LRU, "LRU", 1000000, 32 << 20, 4000000);
+    bench.benchmarkEviction(EvictionPolicy::LFU, "LFU", 1000000, 32 << 20, 4000000);
+    bench.benchmarkEviction(EvictionPolicy::VolatileTTL, "volatile TTL", 1000000, 32 << 20, 4000000);
+    return 0;
+}
@@ -0,0 +1,270 @@
+#include "../shard_node/kvstore.hpp"
+#include "../shard_node/snapshot.hpp"
+#include "../shard_node/wal.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+// Compares snapshot write and load time for the binary snapshot format,
+// plain and with LZ4 or zstd blocks where built in, and the tab-separated
+// text format it replaced, on the same key set. Loading
+// builds a map as KVStore recovery does. Also measures how long puts stall
+// while a KVStore snapshot runs, and full versus delta snapshot cost when
+// few keys change.
+class SnapshotMicrobench {
+private:
+    using Map = std::unordered_map<std::string, std::string>;
+
+    struct Result {
+        double write_ms;
+        double load_ms;
+        uintmax_t file_bytes;
+    };
+
+    static double elapsedMs(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    // Starts each run without the previous run's file or its dirty pages
+    static void settle(const std::string& path) {
+        std::filesystem::remove(path);
+        ::sync();
+    }
+
+    Result runText(const Map& data, const std::string& path) {
+        settle(path);
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::ofstream out(path);
+            out << "KVSNAP\t0\t" << data.size() << '\n';
+            for (const auto& [key, value] : data) {
+                out << key << '\t' << value << '\t' << -1 << '\n';
+            }
+        }
+        double write_ms = elapsedMs(start);
+
+        start = std::chrono::steady_clock::now();
+        Map loaded;
+        {
+            std::ifstream in(path);
+            std::string line;
+            std::getline(in, line);
+            while (std::getline(in, line)) {
+                std::istringstream iss(line);
+                std::string key, value;
+                long long expiry = -1;
+                if (!(iss >> key >> value >> expiry)) continue;
+                loaded[key] = value;
+            }
+        }
+        double load_ms = elapsedMs(start);
+        if (loaded.size() != data.size()) std::cerr << "text load lost entries\n";
+        return {write_ms, load_ms, std::filesystem::file_size(path)};
+    }
+
+    Result runBinary(const Map& data, const std::string& path,
+                     SnapshotCompression compression = SnapshotCompression::None) {
+        settle(path);
+        auto start = std::chrono::steady_clock::now();
+        {
+            SnapshotWriter writer(path, SnapshotKind::Full, compression);
+            for (const auto& [key, value] : data) {
+                writer.add(key, value, 0);
+            }
+            writer.finish(0);
+        }
+        double write_ms = elapsedMs(start);
+
+        start = std::chrono::steady_clock::now();
+        Map loaded;
+        {
+            auto reader = SnapshotReader::open(path);
+            loaded.reserve(reader->getEntryCount());
+            reader->forEach([&loaded](std::string_view key, std::string_view value, uint64_t, bool) {
+                loaded[std::string(key)].assign(value);
+            });
+        }
+        double load_ms = elapsedMs(start);
+        if (loaded.size() != data.size()) std::cerr << "binary load lost entries\n";
+        return {write_ms, load_ms, std::filesystem::file_size(path)};
+    }
+
+    static void keepBest(Result& best, const Result& r) {
+        best = {std::min(best.write_ms, r.write_ms), std::min(best.load_ms, r.load_ms), r.file_bytes};
+    }
+
+    static void print(const char* name, const Result& r) {
+        std::cout << std::left << std::setw(9) << name
+                  << "write " << r.write_ms << " ms, load " << r.load_ms << " ms, "
+                  << (r.file_bytes >> 20) << " MiB" << std::endl;
+    }
+
+    struct Latency {
+        double p50_us;
+        double p999_us;
+        double max_us;
+        size_t ops;
+    };
+
+    // Put latency from one writer, while `snapshotting` runs snapshots or
+    // for the same time without them
+    Latency measurePuts(KVStore& store, size_t entries, bool snapshotting) {
+        std::atomic<bool> done{false};
+        std::vector<double> latencies;
+        std::thread writer([&] {
+            std::string value(100, 'w');
+            for (size_t i = 0; !done; ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                store.put("key_" + std::to_string(i % entries), value);
+                latencies.push_back(std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - begin).count());
+            }
+        });
+        if (snapshotting) {
+            for (int i = 0; i < 3; ++i) store.runSnapshot();
+        } else {
+            std::this_thread::sleep_for(std::chrono::seconds(2));
+        }
+        done = true;
+        writer.join();
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p) { return latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
+        return {percentile(0.50), percentile(0.999), latencies.back(), latencies.size()};
+    }
+
+    static void print(const char* name, const Latency& l) {
+        std::cout << std::left << std::setw(20) << name
+                  << "p50 " << l.p50_us << " us, p99.9 " << l.p999_us << " us, max "
+                  << l.max_us << " us (" << l.ops << " puts)" << std::endl;
+    }
+
+public:
+    void benchmarkWriteStall(size_t entries, size_t value_size) {
+        std::cout << "\n=== Put latency during snapshots ===" << std::endl;
+        std::cout << "Entries: " << entries << ", Value size: " << value_size << " bytes" << std::endl;
+
+        const std::string log = "snapshot_bench_store.log";
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            auto store = KVStore::create(log, options);
+            std::string value(value_size, 'v');
+            for (size_t i = 0; i < entries; ++i) {
+                store->put("key_" + std::to_string(i), value);
+            }
+
+            std::cout << std::fixed << std::setprecision(1);
+            print("idle:", measurePuts(*store, entries, false));
+            print("snapshotting:", measurePuts(*store, entries, true));
+        }
+        WriteAheadLog::removeLog(log);
+        std::filesystem::remove(log + ".snapshot");
+    }
+
+    void benchmarkDeltas(size_t entries, size_t changed) {
+        std::cout << "\n=== Full vs delta snapshots ===" << std::endl;
+        std::cout << "Entries: " << entries << ", Changed between snapshots: " << changed << std::endl;
+
+        const std::string log = "snapshot_bench_delta.log";
+        auto removeFiles = [&log] {
+            WriteAheadLog::removeLog(log);
+            for (const auto& entry : std::filesystem::directory_iterator(".")) {
+                if (entry.path().filename().string().rfind(log + ".snapshot", 0) == 0) {
+                    std::filesystem::remove(entry.path());
+                }
+            }
+        };
+        auto snapshotBytes = [&log] {
+            uintmax_t bytes = 0;
+            for (const auto& entry : std::filesystem::directory_iterator(".")) {
+                if (entry.path().filename().string().rfind(log + ".snapshot", 0) == 0) {
+                    bytes += entry.file_size();
+                }
+            }
+            return bytes;
+        };
+
+        removeFiles();
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.deltaSnapshotsPerFull = 1000;
+            auto store = KVStore::create(log, options);
+            std::string value(100, 'v');
+            for (size_t i = 0; i < entries; ++i) {
+                store->put("key_" + std::to_string(i), value);
+            }
+
+            std::cout << std::fixed << std::setprecision(1);
+            auto start = std::chrono::steady_clock::now();
+            store->runSnapshot();
+            std::cout << std::left << std::setw(9) << "full:" << elapsedMs(start) << " ms, "
+                      << (snapshotBytes() >> 10) << " KiB" << std::endl;
+
+            for (size_t i = 0; i < changed; ++i) {
+                store->put("key_" + std::to_string(i * (entries / changed)), "updated");
+            }
+            uintmax_t before = snapshotBytes();
+            start = std::chrono::steady_clock::now();
+            store->runSnapshot();
+            std::cout << std::left << std::setw(9) << "delta:" << elapsedMs(start) << " ms, "
+                      << ((snapshotBytes() - before) >> 10) << " KiB" << std::endl;
+        }
+        removeFiles();
+    }
+
+    void benchmark(size_t entries, size_t value_size) {
+        std::cout << "\n=== Snapshot format ===" << std::endl;
+        std::cout << "Entries: " << entries << ", Value size: " << value_size << " bytes" << std::endl;
+
+        Map data;
+        data.reserve(entries);
+        for (size_t i = 0; i < entries; ++i) {
+            data["key_" + std::to_string(i)] = std::string(value_size, 'a' + i % 26);
+        }
+
+        const std::string path = "snapshot_bench.snapshot";
+        std::cout << std::fixed << std::setprecision(1);
+        // Best of a few alternating rounds, so neither format pays for the
+        // other's page cache and allocator state
+        Result text{1e18, 1e18, 0}, binary{1e18, 1e18, 0}, lz4{1e18, 1e18, 0}, zstd{1e18, 1e18, 0};
+        for (int round = 0; round < 3; ++round) {
+            keepBest(text, runText(data, path));
+            keepBest(binary, runBinary(data, path));
+            if (ValueCodec::isAvailable(SnapshotCompression::LZ4)) {
+                keepBest(lz4, runBinary(data, path, SnapshotCompression::LZ4));
+            }
+            if (ValueCodec::isAvailable(SnapshotCompression::Zstd)) {
+                keepBest(zstd, runBinary(data, path, SnapshotCompression::Zstd));
+            }
+        }
+        print("text:", text);
+        print("binary:", binary);
+        if (ValueCodec::isAvailable(SnapshotCompression::LZ4)) print("lz4:", lz4);
+        if (ValueCodec::isAvailable(SnapshotCompression::Zstd)) print("zstd:", zstd);
+        std::filesystem::remove(path);
+    }
+};
+
+int main() {
+    SnapshotMicrobench bench;
+    bench.benchmark(1000000, 100);
+    bench.benchmark(100000, 4096);
+    bench.benchmarkWriteStall(1000000, 100);
+    bench.benchmarkDeltas(1000000, 1000);
+    return 0;
+}
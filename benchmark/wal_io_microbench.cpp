@@ -0,0 +1,111 @@
+#include "../shard_node/wal.hpp"
+#include "../shard_node/wal_writer_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compares WAL I/O engines with many partition logs sharing a writer pool:
+// system calls per commit and Sync commit latency percentiles.
+class WalIOMicrobench {
+private:
+    struct Result {
+        double syscalls_per_commit;
+        double ops_per_sec;
+        double p50_us;
+        double p99_us;
+        double p999_us;
+    };
+
+    Result run(WALIOEngine engine, int num_logs, int num_threads, int ops_per_thread, int value_size) {
+        WALWriterPool pool;
+        std::vector<std::string> files;
+        std::vector<std::unique_ptr<WriteAheadLog>> wals;
+        for (int i = 0; i < num_logs; ++i) {
+            files.push_back("wal_io_bench_" + std::to_string(i) + ".log");
+            WriteAheadLog::removeLog(files.back());
+            wals.push_back(std::make_unique<WriteAheadLog>(files.back(),
+                                                           WALOptions{.writerPool = &pool, .ioEngine = engine}));
+        }
+        uint64_t syscalls_before = 0;
+        uint64_t syncs_before = 0;
+        for (auto& wal : wals) {
+            syscalls_before += wal->getIOSyscallCount();
+            syncs_before += wal->getSyncCount();
+        }
+
+        std::vector<std::vector<double>> latencies(num_threads);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t]() {
+                std::string value(value_size, 'v');
+                latencies[t].reserve(ops_per_thread);
+                for (int i = 0; i < ops_per_thread; ++i) {
+                    auto& wal = *wals[(t + i * num_threads) % num_logs];
+                    auto begin = std::chrono::steady_clock::now();
+                    auto seq = wal.appendBatch(WriteAheadLog::encodeRecord(WALOp::Put, "key_" + std::to_string(i), value));
+                    wal.waitFor(seq, Durability::Sync);
+                    latencies[t].push_back(std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - begin).count());
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        uint64_t syscalls = 0;
+        uint64_t syncs = 0;
+        for (auto& wal : wals) {
+            syscalls += wal->getIOSyscallCount();
+            syncs += wal->getSyncCount();
+        }
+        wals.clear();
+        for (const auto& file : files) {
+            WriteAheadLog::removeLog(file);
+        }
+
+        std::vector<double> all;
+        for (auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+        std::sort(all.begin(), all.end());
+        auto percentile = [&all](double p) { return all[static_cast<size_t>(p * (all.size() - 1))]; };
+
+        double total_ops = static_cast<double>(num_threads) * ops_per_thread;
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double commits = static_cast<double>(std::max<uint64_t>(syncs - syncs_before, 1));
+        return {(syscalls - syscalls_before) / commits, total_ops / seconds,
+                percentile(0.50), percentile(0.99), percentile(0.999)};
+    }
+
+    static void print(const char* name, const Result& r) {
+        std::cout << std::left << std::setw(10) << name
+                  << r.syscalls_per_commit << " syscalls/commit, "
+                  << r.ops_per_sec << " ops/sec, p50 " << r.p50_us
+                  << " us, p99 " << r.p99_us << " us, p99.9 " << r.p999_us << " us" << std::endl;
+    }
+
+public:
+    void benchmark(int num_logs, int num_threads, int ops_per_thread, int value_size) {
+        std::cout << "\n=== WAL I/O engines (Sync commits) ===" << std::endl;
+        std::cout << "Logs: " << num_logs << ", Threads: " << num_threads << ", Ops/thread: " << ops_per_thread
+                  << ", Value size: " << value_size << " bytes" << std::endl;
+
+        std::cout << std::fixed << std::setprecision(1);
+        print("pwrite:", run(WALIOEngine::PWrite, num_logs, num_threads, ops_per_thread, value_size));
+        print("io_uring:", run(WALIOEngine::IOUring, num_logs, num_threads, ops_per_thread, value_size));
+    }
+};
+
+int main() {
+    WalIOMicrobench bench;
+    bench.benchmark(64, 16, 500, 128);
+    bench.benchmark(64, 16, 200, 16384);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "../shard_node/wal.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Measures how long writers hold a partition's exclusive lock when the WAL
+// record is built and queued inside the critical section (the old KVStore
+// mutation path) versus encoded up front with only the WAL sequence number
+// reserved under the lock (the current path).
+class WalLockMicrobench {
+private:
+    struct Result {
+        double avg_hold_ns;
+        double ops_per_sec;
+    };
+
+    template <typename Mutation>
+    Result run(const std::string& walFile, int num_threads, int ops_per_thread, int value_size, Mutation mutation) {
+        WriteAheadLog::removeLog(walFile);
+        WriteAheadLog wal(walFile);
+        std::unordered_map<std::string, std::string> store;
+        std::shared_mutex mutex;
+        std::vector<long long> hold_ns(num_threads, 0);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t]() {
+                std::string value(value_size, 'v');
+                for (int i = 0; i < ops_per_thread; ++i) {
+                    std::string key = "key_" + std::to_string(t) + "_" + std::to_string(i % 1000);
+                    hold_ns[t] += mutation(wal, store, mutex, key, value);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        wal.flush();
+        WriteAheadLog::removeLog(walFile);
+
+        long long total_hold = 0;
+        for (auto ns : hold_ns) total_hold += ns;
+        double total_ops = static_cast<double>(num_threads) * ops_per_thread;
+        double seconds = std::chrono::duration<double>(end - start).count();
+        return {total_hold / total_ops, total_ops / seconds};
+    }
+
+public:
+    void benchmark(int num_threads, int ops_per_thread, int value_size) {
+        std::cout << "\n=== Write-lock hold time ===" << std::endl;
+        std::cout << "Threads: " << num_threads << ", Ops/thread: " << ops_per_thread
+                  << ", Value size: " << value_size << " bytes" << std::endl;
+
+        auto inlined = run("wal_lock_bench_inline.log", num_threads, ops_per_thread, value_size,
+            [](WriteAheadLog& wal, auto& store, std::shared_mutex& mutex,
+               const std::string& key, const std::string& value) {
+                std::unique_lock lock(mutex);
+                auto locked = std::chrono::steady_clock::now();
+                store[key] = value;
+                wal.appendBatch(WriteAheadLog::encodeRecord(WALOp::Put, key, value));
+                return (std::chrono::steady_clock::now() - locked).count();
+            });
+
+        auto staged = run("wal_lock_bench_staged.log", num_threads, ops_per_thread, value_size,
+            [](WriteAheadLog& wal, auto& store, std::shared_mutex& mutex,
+               const std::string& key, const std::string& value) {
+                std::string record = WriteAheadLog::encodeRecord(WALOp::Put, key, value);
+                std::string copy = value;
+                uint64_t sequence;
+                long long held;
+                {
+                    std::unique_lock lock(mutex);
+                    auto locked = std::chrono::steady_clock::now();
+                    store[key] = std::move(copy);
+                    sequence = wal.reserveSequence();
+                    held = (std::chrono::steady_clock::now() - locked).count();
+                }
+                wal.submit(sequence, std::move(record));
+                return held;
+            });
+
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << std::left << std::setw(28) << "Encode + enqueue in lock:"
+                  << inlined.avg_hold_ns << " ns held, " << inlined.ops_per_sec << " ops/sec" << std::endl;
+        std::cout << std::left << std::setw(28) << "Reserve sequence in lock:"
+                  << staged.avg_hold_ns << " ns held, " << staged.ops_per_sec << " ops/sec" << std::endl;
+    }
+};
+
+int main() {
+    WalLockMicrobench bench;
+    bench.benchmark(8, 100000, 64);
+    bench.benchmark(8, 50000, 4096);
+    return 0;
+}
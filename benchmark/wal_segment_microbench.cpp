@@ -0,0 +1,78 @@
+#include "../shard_node/wal.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+// Measures Sync commit cost for a single writer as segments fill up and get
+// retired, with segments that grow on every append, preallocated segments,
+// and preallocated segments that are recycled after retirement.
+class WalSegmentMicrobench {
+private:
+    struct Result {
+        double avg_commit_us;
+        double p99_commit_us;
+        uint64_t recycled;
+    };
+
+    Result run(const WALOptions& options, int commits, int value_size) {
+        const std::string walFile = "wal_segment_bench.log";
+        WriteAheadLog::removeLog(walFile);
+        std::vector<double> latencies;
+        latencies.reserve(commits);
+        uint64_t recycled = 0;
+        {
+            WriteAheadLog wal(walFile, options);
+            std::string value(value_size, 'v');
+            for (int i = 0; i < commits; ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                auto seq = wal.appendBatch(WriteAheadLog::encodeRecord(WALOp::Put, "key_" + std::to_string(i), value));
+                wal.waitFor(seq, Durability::Sync);
+                latencies.push_back(std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - begin).count());
+
+                // Checkpoint often enough that only a couple of segments stay live
+                if (wal.getSegmentCount() > 2) {
+                    wal.retireSegments(seq);
+                }
+            }
+            recycled = wal.getRecycleCount();
+        }
+        WriteAheadLog::removeLog(walFile);
+
+        double total = 0;
+        for (double l : latencies) total += l;
+        std::sort(latencies.begin(), latencies.end());
+        return {total / latencies.size(), latencies[static_cast<size_t>(0.99 * (latencies.size() - 1))], recycled};
+    }
+
+    static void print(const char* name, const Result& r) {
+        std::cout << std::left << std::setw(26) << name
+                  << "avg " << r.avg_commit_us << " us, p99 " << r.p99_commit_us
+                  << " us, " << r.recycled << " segments recycled" << std::endl;
+    }
+
+public:
+    void benchmark(int commits, int value_size, size_t segment_size) {
+        std::cout << "\n=== WAL segment allocation (Sync commits) ===" << std::endl;
+        std::cout << "Commits: " << commits << ", Value size: " << value_size
+                  << " bytes, Segment size: " << (segment_size >> 20) << " MiB" << std::endl;
+
+        std::cout << std::fixed << std::setprecision(1);
+        print("Growing segments:", run(WALOptions{.segmentSize = segment_size, .preallocate = false,
+                                                  .recycledSegments = 0}, commits, value_size));
+        print("Preallocated:", run(WALOptions{.segmentSize = segment_size, .preallocate = true,
+                                              .recycledSegments = 0}, commits, value_size));
+        print("Preallocated + recycled:", run(WALOptions{.segmentSize = segment_size, .preallocate = true,
+                                                         .recycledSegments = 4}, commits, value_size));
+    }
+};
+
+int main() {
+    WalSegmentMicrobench bench;
+    bench.benchmark(20000, 4096, 4 << 20);
+    bench.benchmark(20000, 512, 1 << 20);
+    return 0;
+}
@@ -2,45 +2,175 @@
 #include "kvstore.hpp"
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <future>
+#include "thread_pool.hpp"
 #include "wal.hpp"
+#include "wal_writer_pool.hpp"
+#include "maintenance_scheduler.hpp"
 
 class PartitionedKVStore {
     private:
         size_t partitionCount;
+        // Declaration order matters for teardown: the scheduler stops first,
+        // then the partitions flush their WALs, then the writer pool exits
+        std::unique_ptr<WALWriterPool> walWriters;
         std::vector<std::unique_ptr<KVStore>> partitions;
+        MaintenanceScheduler scheduler;
+        std::chrono::microseconds recoveryTime{0};
 
-        size_t getPartitionIndex(const std::string& key) const {
-            return std::hash<std::string>{}(key) % partitionCount;
+        size_t getPartitionIndex(const HashedKey& key) const {
+            return key.hash % partitionCount;
         }
     public:
-        // Constructor with configurable partition count
-        PartitionedKVStore(size_t numPartitions = 16) : partitionCount(numPartitions), partitions(numPartitions) {
+        // Constructor with configurable partition count. All partition WALs
+        // share `walWriterThreads` writer threads, and TTL cleanup and
+        // snapshots for every partition run on one scheduler thread.
+        // Partitions recover independently, `recoveryThreads` at a time.
+        PartitionedKVStore(size_t numPartitions = 16, const KVStoreOptions& options = {},
+                           size_t walWriterThreads = WALWriterPool::DEFAULT_THREADS,
+                           size_t recoveryThreads = std::thread::hardware_concurrency())
+            : partitionCount(numPartitions),
+              walWriters(std::make_unique<WALWriterPool>(walWriterThreads)),
+              partitions(numPartitions) {
+            KVStoreOptions partitionOptions = options;
+            partitionOptions.wal.writerPool = walWriters.get();
+            partitionOptions.backgroundThreads = false;
+            // Keys spread evenly, so each partition gets an even share
+            if (options.maxMemoryBytes > 0) {
+                size_t share = options.maxMemoryBytes / std::max<size_t>(partitionCount, 1);
+                partitionOptions.maxMemoryBytes = std::max<size_t>(share, 1);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            {
+                ThreadPool recoveryPool(std::clamp<size_t>(recoveryThreads, 1, std::max<size_t>(partitionCount, 1)));
+                std::vector<std::future<std::unique_ptr<KVStore>>> recovered;
+                recovered.reserve(partitionCount);
+                for (size_t i = 0; i < partitionCount; ++i) {
+                    recovered.push_back(recoveryPool.submit([i, &partitionOptions] {
+                        return KVStore::create("WAL_partition_" + std::to_string(i) + ".log", partitionOptions);
+                    }));
+                }
+                for (size_t i = 0; i < partitionCount; ++i) {
+                    partitions[i] = recovered[i].get();
+                }
+            }
+            recoveryTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+
+            auto cleanupInterval = std::chrono::milliseconds(options.cleanupIntervalMs);
+            scheduler.schedule(cleanupInterval, cleanupInterval, [this] {
+                for (auto& partition : partitions) {
+                    partition->runCleanup();
+                }
+            });
+            // Stagger snapshots across the interval so they don't all hit the disk at once
+            auto snapshotInterval = std::chrono::milliseconds(options.snapshotIntervalSeconds * 1000);
             for (size_t i = 0; i < partitionCount; ++i) {
-                partitions[i] = KVStore::create("WAL_partition_" + std::to_string(i) + ".log");
+                auto offset = snapshotInterval * (i + 1) / partitionCount;
+                scheduler.schedule(snapshotInterval, offset, [partition = partitions[i].get()] {
+                    partition->runSnapshot();
+                });
             }
         }
         
         // Get current partition count
         size_t getPartitionCount() const { return partitionCount; }
+
+        const WALWriterPool& getWALWriterPool() const { return *walWriters; }
+
+        // Wall-clock time spent recovering all partitions
+        std::chrono::microseconds getRecoveryTime() const { return recoveryTime; }
+
+        // Recovery phases summed over partitions (CPU time across the
+        // recovery threads, so it can exceed getRecoveryTime())
+        RecoveryStats getRecoveryStats() const {
+            RecoveryStats total;
+            for (const auto& partition : partitions) {
+                const auto& stats = partition->getRecoveryStats();
+                total.snapshotLoad += stats.snapshotLoad;
+                total.walReplay += stats.walReplay;
+                total.snapshotEntries += stats.snapshotEntries;
+                total.deltaSnapshots += stats.deltaSnapshots;
+                total.walRecords += stats.walRecords;
+            }
+            return total;
+        }
         
-        void put(const std::string& key, const std::string& value) {
+        // Each partition keeps its own slabs and count
+        MemoryStats getPartitionMemoryStats(size_t partition) const {
+            return partitions[partition]->getMemoryStats();
+        }
+
+        // Summed over partitions; fragmentation is weighted by slab memory
+        MemoryStats getMemoryStats() const {
+            MemoryStats total;
+            double freeBytes = 0;
+            for (const auto& partition : partitions) {
+                auto stats = partition->getMemoryStats();
+                total.bytesUsed += stats.bytesUsed;
+                total.expiryIndexBytes += stats.expiryIndexBytes;
+                total.bytesRetired += stats.bytesRetired;
+                total.slabBytes += stats.slabBytes;
+                freeBytes += stats.fragmentation * stats.slabBytes;
+                total.compactions += stats.compactions;
+                total.entriesMoved += stats.entriesMoved;
+                total.keysEvicted += stats.keysEvicted;
+                total.bytesEvicted += stats.bytesEvicted;
+                total.evictionMisses += stats.evictionMisses;
+            }
+            if (total.slabBytes > 0) total.fragmentation = freeBytes / total.slabBytes;
+            return total;
+        }
+
+        // Summed over partitions
+        CompressionStats getCompressionStats() const {
+            CompressionStats total;
+            for (const auto& partition : partitions) {
+                auto stats = partition->getCompressionStats();
+                total.valuesCompressed += stats.valuesCompressed;
+                total.valuesIncompressible += stats.valuesIncompressible;
+                total.rawBytes += stats.rawBytes;
+                total.storedBytes += stats.storedBytes;
+            }
+            if (total.storedBytes > 0) total.ratio = static_cast<double>(total.rawBytes) / total.storedBytes;
+            return total;
+        }
+        
+        // The key is hashed once here; the partition index and, inside the
+        // partition, the slice and table slot all come from that hash
+        // Pass the value as an rvalue std::string to hand it over uncopied
+        void put(const HashedKey& key, PutValue value) {
             size_t partitionIndex = getPartitionIndex(key);
-            partitions[partitionIndex]->put(key, value);
+            partitions[partitionIndex]->put(key, std::move(value));
         }
 
-        void put(const std::string& key, const std::string& value, int ttl_ms) {
+        void put(const HashedKey& key, PutValue value, int ttl_ms) {
             size_t partitionIndex = getPartitionIndex(key);
-            partitions[partitionIndex]->put(key, value, ttl_ms);
+            partitions[partitionIndex]->put(key, std::move(value), ttl_ms);
         }
 
-        std::optional<std::string> get(const std::string& key) {
+        void put(const HashedKey& key, PutValue value, Durability durability) {
+            partitions[getPartitionIndex(key)]->put(key, std::move(value), durability);
+        }
+
+        void put(const HashedKey& key, PutValue value, int ttl_ms, Durability durability) {
+            partitions[getPartitionIndex(key)]->put(key, std::move(value), ttl_ms, durability);
+        }
+
+        std::optional<std::string> get(const HashedKey& key) {
             return partitions[getPartitionIndex(key)]->get(key);
         }
 
-        void remove(const std::string& key) {
+        void remove(const HashedKey& key) {
             partitions[getPartitionIndex(key)]->remove(key);
         }
 
+        void remove(const HashedKey& key, Durability durability) {
+            partitions[getPartitionIndex(key)]->remove(key, durability);
+        }
+
         void shutdown() {
             // For future use, if needed
         }
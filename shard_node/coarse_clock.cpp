@@ -0,0 +1,49 @@
+#include "coarse_clock.hpp"
+
+#include <algorithm>
+
+CoarseClock::CoarseClock() {
+    cached.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    ticker = std::thread(&CoarseClock::run, this);
+}
+
+CoarseClock::~CoarseClock() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopFlag = true;
+    }
+    condition.notify_one();
+    ticker.join();
+}
+
+CoarseClock& CoarseClock::instance() {
+    static CoarseClock clock;
+    return clock;
+}
+
+// First read in the process: starts the ticker, and answers precisely
+CoarseClock::Clock::time_point CoarseClock::start() {
+    instance();
+    return Clock::now();
+}
+
+void CoarseClock::setResolution(std::chrono::microseconds resolution) {
+    auto& clock = instance();
+    resolution = std::max(resolution, std::chrono::microseconds(1));
+    clock.resolution.store(std::chrono::duration_cast<Clock::duration>(resolution).count(),
+                           std::memory_order_relaxed);
+    clock.condition.notify_one(); // Don't sit out the old, possibly long, interval
+}
+
+std::chrono::microseconds CoarseClock::getResolution() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::duration(instance().resolution.load(std::memory_order_relaxed)));
+}
+
+void CoarseClock::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopFlag) {
+        cached.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        condition.wait_for(lock, Clock::duration(resolution.load(std::memory_order_relaxed)));
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Process-wide steady_clock reading refreshed by a background thread, for
+// TTL checks that would otherwise read the clock once per key. now() is a
+// single atomic load and may lag the real clock by up to the resolution,
+// so keys can outlive their deadline by that much. The thread starts on
+// first use.
+class CoarseClock {
+    public:
+        using Clock = std::chrono::steady_clock;
+        static constexpr std::chrono::microseconds DEFAULT_RESOLUTION{1000};
+
+    private:
+        static inline std::atomic<Clock::rep> cached{0}; // 0 until the ticker runs
+        std::atomic<Clock::rep> resolution{std::chrono::duration_cast<Clock::duration>(DEFAULT_RESOLUTION).count()};
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopFlag = false;
+        std::thread ticker;
+
+        CoarseClock();
+        ~CoarseClock();
+        static CoarseClock& instance();
+        static Clock::time_point start();
+        void run();
+
+    public:
+        static Clock::time_point now() {
+            Clock::rep ticks = cached.load(std::memory_order_relaxed);
+            if (ticks == 0) [[unlikely]] return start();
+            return Clock::time_point(Clock::duration(ticks));
+        }
+
+        // How often the cached time is refreshed; applies to the whole process
+        static void setResolution(std::chrono::microseconds resolution);
+        static std::chrono::microseconds getResolution();
+};
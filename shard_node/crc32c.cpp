@@ -0,0 +1,127 @@
+#include "crc32c.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define KV_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define KV_CRC32C_ARM 1
+#endif
+
+namespace {
+
+constexpr uint32_t kPolynomial = 0x82F63B78; // Reflected Castagnoli polynomial
+
+using Table = std::array<std::array<uint32_t, 256>, 8>;
+
+constexpr Table makeTable() {
+    Table table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+        }
+        table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (size_t slice = 1; slice < 8; ++slice) {
+            uint32_t prev = table[slice - 1][i];
+            table[slice][i] = (prev >> 8) ^ table[0][prev & 0xFF];
+        }
+    }
+    return table;
+}
+
+constexpr Table kTable = makeTable();
+
+uint32_t crc32cSoftware(const uint8_t* p, size_t length, uint32_t crc) {
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        word ^= crc;
+        crc = kTable[7][word & 0xFF] ^
+              kTable[6][(word >> 8) & 0xFF] ^
+              kTable[5][(word >> 16) & 0xFF] ^
+              kTable[4][(word >> 24) & 0xFF] ^
+              kTable[3][(word >> 32) & 0xFF] ^
+              kTable[2][(word >> 40) & 0xFF] ^
+              kTable[1][(word >> 48) & 0xFF] ^
+              kTable[0][word >> 56];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ kTable[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(KV_CRC32C_X86)
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(const uint8_t* p, size_t length, uint32_t crc) {
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        length -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+bool detectHardware() {
+    return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(KV_CRC32C_ARM)
+uint32_t crc32cHardware(const uint8_t* p, size_t length, uint32_t crc) {
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc = __crc32cd(crc, word);
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+
+bool detectHardware() {
+    return true;
+}
+#else
+uint32_t crc32cHardware(const uint8_t* p, size_t length, uint32_t crc) {
+    return crc32cSoftware(p, length, crc);
+}
+
+bool detectHardware() {
+    return false;
+}
+#endif
+
+const bool hasHardwareCrc = detectHardware();
+
+} // namespace
+
+uint32_t crc32c(const void* data, size_t length, uint32_t crc) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    crc = hasHardwareCrc ? crc32cHardware(p, length, crc)
+                         : crc32cSoftware(p, length, crc);
+    return ~crc;
+}
+
+bool crc32cHardwareAccelerated() {
+    return hasHardwareCrc;
+}
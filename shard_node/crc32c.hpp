@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C (Castagnoli) used to checksum WAL records and snapshots.
+// Uses the SSE4.2 / ARMv8 CRC instructions when the CPU has them and falls
+// back to a slicing-by-8 table implementation otherwise.
+// Pass a previous result as `crc` to extend a checksum over several buffers.
+uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0);
+
+// True when crc32c() is backed by a hardware instruction.
+bool crc32cHardwareAccelerated();
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// How far a write must travel before put/remove returns.
+enum class Durability : uint8_t {
+    None,  // Return once the record is queued for the WAL writer
+    Flush, // Return once the record has been written to the OS page cache
+    Sync,  // Return once the record has been fdatasync'ed to stable storage
+};
@@ -0,0 +1,129 @@
+#include "entry.hpp"
+#include "epoch_reclaimer.hpp"
+
+#include <new>
+#include <utility>
+
+char* Entry::allocateBlock(size_t bytes, size_t external, SlabAllocator* slabs) {
+    return slabs ? static_cast<char*>(slabs->allocate(bytes, external)) : new char[bytes];
+}
+
+// Allocates the block and fills in everything before the value; returns
+// where the value's `valueBytes` go
+char* Entry::build(std::string_view key, size_t valueLength, size_t valueBytes,
+                   std::optional<Clock::time_point> expiration, uint8_t flags, SlabAllocator* slabs,
+                   std::optional<uint32_t> access) {
+    bool shortLengths = key.size() <= UINT8_MAX && valueLength <= UINT8_MAX;
+    if (shortLengths) flags |= SHORT_LENGTHS;
+
+    uint64_t deadline = 0;
+    if (expiration) {
+        flags |= HAS_TTL;
+        auto sinceEpoch = *expiration - EPOCH;
+        if (sinceEpoch > Clock::duration::zero()) {
+            // Rounded up, so the entry never expires before its deadline
+            auto ms = std::chrono::ceil<std::chrono::milliseconds>(sinceEpoch);
+            deadline = static_cast<uint64_t>(ms.count());
+        }
+        if (deadline > UINT32_MAX) flags |= WIDE_TTL;
+    }
+
+    size_t lengthsBytes = shortLengths ? 2 : 8;
+    size_t deadlineBytes = flags & WIDE_TTL ? 8 : flags & HAS_TTL ? 4 : 0;
+    if (slabs) flags |= POOLED;
+    if (access) flags |= TRACKED;
+    size_t accessBytes = access ? ACCESS_SIZE : 0;
+    size_t external = flags & SHARED_VALUE ? valueLength : 0;
+    char* data = allocateBlock(accessBytes + 1 + lengthsBytes + deadlineBytes + key.size() + valueBytes,
+                               external, slabs);
+    if (access) new (data) uint32_t(*access);
+    data += accessBytes;
+    block = data;
+
+    char* p = data;
+    *p++ = static_cast<char>(flags);
+    if (shortLengths) {
+        *p++ = static_cast<char>(key.size());
+        *p++ = static_cast<char>(valueLength);
+    } else {
+        storeFixed32(p, static_cast<uint32_t>(key.size()));
+        storeFixed32(p + 4, static_cast<uint32_t>(valueLength));
+        p += 8;
+    }
+    if (flags & WIDE_TTL) {
+        storeFixed64(p, deadline);
+    } else if (flags & HAS_TTL) {
+        storeFixed32(p, static_cast<uint32_t>(deadline));
+    }
+    p += deadlineBytes;
+    std::memcpy(p, key.data(), key.size());
+    return p + key.size();
+}
+
+Entry::Entry(std::string_view key, std::string_view value, std::optional<Clock::time_point> expiration,
+             SlabAllocator* slabs, std::optional<uint32_t> access, bool compressed) {
+    char* p = build(key, value.size(), value.size(), expiration, compressed ? COMPRESSED : 0, slabs, access);
+    std::memcpy(p, value.data(), value.size());
+}
+
+Entry::Entry(std::string_view key, SharedValue value, std::optional<Clock::time_point> expiration,
+             SlabAllocator* slabs, std::optional<uint32_t> access, bool compressed) {
+    char* p = build(key, value.size(), sizeof(void*), expiration, SHARED_VALUE | (compressed ? COMPRESSED : 0),
+                    slabs, access);
+    void* handle = value.release();
+    std::memcpy(p, &handle, sizeof(handle));
+}
+
+Entry Entry::copy(const EntryView& entry, SlabAllocator* slabs) {
+    size_t bytes = entry.blockSize();
+    char* data = allocateBlock(bytes, entry.externalSize(), slabs);
+    std::memcpy(data, entry.allocation(), bytes);
+    if (entry.isTracked()) {
+        new (data) uint32_t(entry.getAccess());
+        data += ACCESS_SIZE;
+    }
+    data[0] = static_cast<char>(slabs ? entry.flags() | POOLED : entry.flags() & ~POOLED);
+    if (entry.hasSharedValue()) {
+        // The copy holds a reference of its own
+        SharedValue value = SharedValue::adopt(const_cast<void*>(entry.sharedHandle()));
+        SharedValue(value).release();
+        value.release();
+    }
+    Entry copy;
+    copy.block = data;
+    return copy;
+}
+
+Entry& Entry::operator=(Entry&& other) noexcept {
+    if (this != &other) {
+        destroyBlock(const_cast<char*>(block));
+        block = std::exchange(other.block, nullptr);
+    }
+    return *this;
+}
+
+void Entry::retireBlock(const char* block) {
+    EntryView entry(block);
+    size_t bytes = entry.blockSize();
+    if (entry.flags() & POOLED) {
+        SlabAllocator::retire(entry.allocation(), bytes, entry.externalSize());
+        EpochReclaimer::retire(const_cast<char*>(block), &destroyRetiredBlock, bytes);
+    } else {
+        EpochReclaimer::retire(const_cast<char*>(block), &destroyBlock, bytes);
+    }
+}
+
+void Entry::destroy(void* block, bool retired) {
+    if (!block) return;
+    EntryView entry(static_cast<const char*>(block));
+    // Takes back the block's reference, dropped on return, before the
+    // block's memory can be reused
+    SharedValue value;
+    if (entry.hasSharedValue()) value = SharedValue::adopt(const_cast<void*>(entry.sharedHandle()));
+    void* memory = const_cast<char*>(entry.allocation());
+    if (entry.flags() & POOLED) {
+        SlabAllocator::deallocate(memory, entry.blockSize(), value.size(), retired);
+    } else {
+        delete[] static_cast<char*>(memory);
+    }
+}
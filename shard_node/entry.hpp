@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "coding.hpp"
+#include "shared_value.hpp"
+#include "slab_allocator.hpp"
+
+// One key-value pair in a single heap block, referenced by one pointer:
+//
+//   u8 flags | lengths | deadline | key | value
+//
+// lengths are a u8 keyLen and u8 valueLen when both fit (SHORT_LENGTHS),
+// otherwise two u32s. deadline is only present for keys with a TTL: ms
+// after EPOCH, rounded up, as a u32 (about 49 days), or a u64 (WIDE_TTL)
+// beyond that. Compared with a std::string key, std::string value and
+// std::optional deadline, this saves two allocations and ~60 bytes a key.
+// An entry built from a SharedValue (SHARED_VALUE) holds, in place of the
+// value, a handle to that buffer and one reference on it. A block built
+// with a SlabAllocator (POOLED) goes back to it when freed. An entry of a
+// store that evicts (TRACKED) is preceded by a u32 access word, the one
+// part of a block that changes once it is built. A COMPRESSED entry's value
+// is a ValueCodec frame, decompressed by whoever reads it.
+//
+// EntryView reads a block; Entry owns one.
+
+// Read-only view of an entry's block. Blocks are never modified once built,
+// apart from the access word, so a view stays valid for as long as its
+// block is allocated.
+class EntryView {
+    public:
+        using Clock = std::chrono::steady_clock;
+        // Deadlines are stored relative to process start
+        static inline const Clock::time_point EPOCH = Clock::now();
+
+    protected:
+        static constexpr uint8_t SHORT_LENGTHS = 1 << 0;
+        static constexpr uint8_t HAS_TTL = 1 << 1;
+        static constexpr uint8_t WIDE_TTL = 1 << 2;
+        static constexpr uint8_t SHARED_VALUE = 1 << 3;
+        static constexpr uint8_t POOLED = 1 << 4;
+        static constexpr uint8_t TRACKED = 1 << 5;
+        static constexpr uint8_t COMPRESSED = 1 << 6;
+        static constexpr size_t ACCESS_SIZE = sizeof(uint32_t);
+
+        const char* block = nullptr;
+
+    private:
+        friend class Entry; // Frees blocks, shared values included
+
+        uint8_t flags() const { return static_cast<uint8_t>(block[0]); }
+        // Where the block's memory starts, the access word included
+        const char* allocation() const { return flags() & TRACKED ? block - ACCESS_SIZE : block; }
+        std::atomic_ref<uint32_t> accessWord() const {
+            return std::atomic_ref<uint32_t>(*reinterpret_cast<uint32_t*>(const_cast<char*>(allocation())));
+        }
+        size_t lengthsSize() const { return flags() & SHORT_LENGTHS ? 2 : 8; }
+        size_t deadlineSize() const { return flags() & WIDE_TTL ? 8 : flags() & HAS_TTL ? 4 : 0; }
+        size_t keyLength() const {
+            return flags() & SHORT_LENGTHS ? static_cast<uint8_t>(block[1]) : getFixed32(block + 1);
+        }
+        size_t valueLength() const {
+            return flags() & SHORT_LENGTHS ? static_cast<uint8_t>(block[2]) : getFixed32(block + 5);
+        }
+        const char* keyData() const { return block + 1 + lengthsSize() + deadlineSize(); }
+        uint64_t deadlineMs() const {
+            const char* p = block + 1 + lengthsSize();
+            return flags() & WIDE_TTL ? getFixed64(p) : getFixed32(p);
+        }
+        const void* sharedHandle() const {
+            const void* handle;
+            std::memcpy(&handle, keyData() + keyLength(), sizeof(handle));
+            return handle;
+        }
+        bool hasSharedValue() const { return flags() & SHARED_VALUE; }
+
+    public:
+        EntryView() = default;
+        explicit EntryView(const char* block) : block(block) {}
+
+        std::string_view getKey() const { return {keyData(), keyLength()}; }
+        // The value as stored, compressed if isCompressed()
+        std::string_view getValue() const {
+            if (hasSharedValue()) return SharedValue::view(sharedHandle());
+            return {keyData() + keyLength(), valueLength()};
+        }
+        bool isCompressed() const { return flags() & COMPRESSED; }
+        bool hasExpiration() const { return flags() & HAS_TTL; }
+        // The deadline as stored, which may be up to 1 ms later than the one
+        // passed in
+        std::optional<Clock::time_point> getExpiration() const {
+            if (!hasExpiration()) return std::nullopt;
+            return EPOCH + std::chrono::milliseconds(deadlineMs());
+        }
+        bool isExpired(Clock::time_point now) const {
+            return hasExpiration() && now >= EPOCH + std::chrono::milliseconds(deadlineMs());
+        }
+        // Bytes the block takes, header and access word included; a shared
+        // value's buffer is not counted
+        size_t blockSize() const {
+            return (flags() & TRACKED ? ACCESS_SIZE : 0) + keyData() - block + keyLength() +
+                   (hasSharedValue() ? sizeof(void*) : valueLength());
+        }
+        // Bytes the entry holds outside its block
+        size_t externalSize() const { return hasSharedValue() ? getValue().size() : 0; }
+
+        // What the store last recorded about reads of the key, for choosing
+        // what to evict. Updated by readers without a lock; concurrent
+        // updates may lose one another. Only tracked entries have one.
+        bool isTracked() const { return flags() & TRACKED; }
+        uint32_t getAccess() const { return accessWord().load(std::memory_order_relaxed); }
+        void setAccess(uint32_t access) const { accessWord().store(access, std::memory_order_relaxed); }
+};
+
+// Owns one entry's block
+class Entry : public EntryView {
+    private:
+        friend class EntryTable; // Loads block pointers for lock-free reads
+
+        static char* allocateBlock(size_t bytes, size_t external, SlabAllocator* slabs);
+        char* build(std::string_view key, size_t valueLength, size_t valueBytes,
+                    std::optional<Clock::time_point> expiration, uint8_t flags, SlabAllocator* slabs,
+                    std::optional<uint32_t> access);
+        static void destroy(void* block, bool retired);
+        static void destroyRetiredBlock(void* block) { destroy(block, true); }
+
+    public:
+        // Blocks come from `slabs` when given, otherwise from the heap. An
+        // entry given an access word is tracked. `compressed` marks a value
+        // that is a ValueCodec frame.
+        Entry() = default;
+        Entry(std::string_view key, std::string_view value,
+              std::optional<Clock::time_point> expiration = std::nullopt, SlabAllocator* slabs = nullptr,
+              std::optional<uint32_t> access = std::nullopt, bool compressed = false);
+        // Keeps a reference to the value instead of copying it
+        Entry(std::string_view key, SharedValue value,
+              std::optional<Clock::time_point> expiration = std::nullopt, SlabAllocator* slabs = nullptr,
+              std::optional<uint32_t> access = std::nullopt, bool compressed = false);
+        // The same entry in a new block, for moving it out of a slab
+        static Entry copy(const EntryView& entry, SlabAllocator* slabs);
+        Entry(Entry&& other) noexcept : EntryView(std::exchange(other.block, nullptr)) {}
+        Entry& operator=(Entry&& other) noexcept;
+        Entry(const Entry&) = delete;
+        Entry& operator=(const Entry&) = delete;
+        ~Entry() { destroyBlock(const_cast<char*>(block)); }
+
+        // Gives up the block, for freeing later with destroyBlock() or
+        // retireBlock()
+        const char* release() { return std::exchange(block, nullptr); }
+        static void destroyBlock(void* block) { destroy(block, false); }
+        // Frees the block through EpochReclaimer, once no reader can hold
+        // it; its allocator stops counting it as used at once
+        static void retireBlock(const char* block);
+
+        // Whether the block sits in a slab being emptied by compaction
+        bool isEvacuating() const {
+            return (flags() & POOLED) && SlabAllocator::isEvacuating(allocation(), blockSize());
+        }
+};
+
+// Hashes and compares entries by key, and lets sets of them be searched by
+// a plain key without building an Entry
+struct EntryHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    size_t operator()(const Entry& entry) const { return (*this)(entry.getKey()); }
+};
+
+// A key with its hash, so the hash is computed once per request and reused
+// to pick the partition, the slice and the table slot. Converts from any
+// string-like key; the view must outlive the call it is passed to.
+struct HashedKey {
+    std::string_view view;
+    size_t hash;
+
+    HashedKey(std::string_view key) : view(key), hash(EntryHash{}(key)) {}
+    HashedKey(const std::string& key) : HashedKey(std::string_view(key)) {}
+    HashedKey(const char* key) : HashedKey(std::string_view(key)) {}
+};
+
+struct EntryKeyEqual {
+    using is_transparent = void;
+    static std::string_view keyOf(std::string_view key) { return key; }
+    static std::string_view keyOf(const Entry& entry) { return entry.getKey(); }
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const { return keyOf(a) == keyOf(b); }
+};
+
+#if defined(__GLIBCXX__)
+// libstdc++ only keeps hash codes in set nodes for hashers it considers
+// slow. Without them, walking a bucket rehashes every neighbour's key
+// through its block pointer; with them, the node still fits the same
+// 32-byte allocation.
+template <>
+struct std::__is_fast_hash<EntryHash> : std::false_type {};
+#endif
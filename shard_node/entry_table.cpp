@@ -0,0 +1,143 @@
+#include "entry_table.hpp"
+
+#include <algorithm>
+#include <new>
+
+#include "epoch_reclaimer.hpp"
+
+namespace {
+
+// At most 7/8 of the slots are ever full, so probes stay short
+size_t maxLoad(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+} // namespace
+
+EntryTable::Storage* EntryTable::Storage::allocate(size_t capacity) {
+    auto* s = static_cast<Storage*>(::operator new(bytes(capacity)));
+    s->capacity = capacity;
+    std::fill_n(s->ctrl(), capacity, EMPTY);
+    std::uninitialized_default_construct_n(s->slots(), capacity);
+    return s;
+}
+
+// Nothing reads the table any more, so blocks can go straight away
+EntryTable::~EntryTable() {
+    Storage* s = current();
+    if (!s) return;
+    std::destroy_n(s->slots(), s->capacity);
+    Storage::destroy(s);
+}
+
+size_t EntryTable::capacityFor(size_t entries) {
+    size_t needed = entries + entries / 7 + 1;
+    return std::max(GROUP_WIDTH, std::bit_ceil(needed));
+}
+
+// First EMPTY or DELETED slot along the key's probe sequence
+size_t EntryTable::findFreeSlot(uint64_t hash) const {
+    const int8_t* ctrl = this->ctrl();
+    size_t groupMask = capacity - 1;
+    size_t group = firstGroup(hash, capacity);
+    for (size_t step = GROUP_WIDTH;; step += GROUP_WIDTH) {
+        uint32_t free = Group(&ctrl[group]).matchFree();
+        if (free) return group + std::countr_zero(free);
+        group = (group + step) & groupMask;
+    }
+}
+
+// Publishes the block with release, pairing with findBlock()'s load
+void EntryTable::setSlot(size_t slot, Entry&& entry) {
+    std::atomic_ref<const char*>(slots()[slot].block).store(entry.release(), std::memory_order_release);
+}
+
+// Leaves the slot null; the block is freed once lock-free readers are done
+void EntryTable::retire(Entry& entry) {
+    const char* block = entry.block;
+    std::atomic_ref<const char*>(entry.block).store(nullptr, std::memory_order_relaxed);
+    Entry::retireBlock(block);
+}
+
+void EntryTable::rehash(size_t newCapacity) {
+    WriteSection section(version);
+    Storage* old = current();
+    Storage* fresh = Storage::allocate(newCapacity);
+    int8_t* ctrl = fresh->ctrl();
+    Entry* slots = fresh->slots();
+    if (old) {
+        for (size_t i = 0; i < old->capacity; ++i) {
+            if (old->ctrl()[i] < 0) continue;
+            uint64_t hash = mix(EntryHash{}(old->slots()[i]));
+            size_t groupMask = newCapacity - 1;
+            size_t group = firstGroup(hash, newCapacity);
+            uint32_t free;
+            for (size_t step = GROUP_WIDTH; !(free = Group(&ctrl[group]).matchFree()); step += GROUP_WIDTH) {
+                group = (group + step) & groupMask;
+            }
+            size_t slot = group + std::countr_zero(free);
+            ctrl[slot] = h2(hash);
+            // Readers may still be looking at the old array, so its
+            // pointers are copied rather than moved out. It is freed
+            // without running destructors.
+            slots[slot].block = old->slots()[i].block;
+        }
+    }
+    storage.store(fresh, std::memory_order_release);
+    capacity = newCapacity;
+    growthLeft = maxLoad(newCapacity) - count;
+    if (old) EpochReclaimer::retire(old, &Storage::destroy, Storage::bytes(old->capacity));
+}
+
+void EntryTable::reserve(size_t entries) {
+    if (entries > 0 && (capacity == 0 || entries > maxLoad(capacity))) {
+        rehash(capacityFor(std::max(entries, count)));
+    }
+}
+
+std::pair<EntryTable::const_iterator, bool> EntryTable::insert(Entry&& entry, size_t keyHash) {
+    std::string_view key = entry.getKey();
+    uint64_t hash = mix(keyHash);
+    if (count > 0) {
+        size_t slot = findSlot(key, hash);
+        if (slot != capacity) return {const_iterator(this, slot), false};
+    }
+
+    if (capacity == 0) rehash(GROUP_WIDTH);
+    size_t slot = findFreeSlot(hash);
+    if (growthLeft == 0 && ctrl()[slot] == EMPTY) {
+        // Out of room, or of EMPTY slots because of tombstones, which a
+        // rehash at the same size clears
+        rehash(count * 2 >= maxLoad(capacity) ? capacity * 2 : capacity);
+        slot = findFreeSlot(hash);
+    }
+    WriteSection section(version);
+    if (ctrl()[slot] == EMPTY) --growthLeft;
+    setCtrl(slot, h2(hash));
+    setSlot(slot, std::move(entry));
+    ++count;
+    return {const_iterator(this, slot), true};
+}
+
+void EntryTable::replace(const_iterator it, Entry&& entry) {
+    WriteSection section(version);
+    retire(slots()[it.slot]);
+    setSlot(it.slot, std::move(entry));
+}
+
+void EntryTable::erase(const_iterator it) {
+    WriteSection section(version);
+    size_t slot = it.slot;
+    retire(slots()[slot]);
+    // Lookups stop at the first group with an EMPTY slot. One that has an
+    // EMPTY now has never been full, so no key was placed past it and the
+    // slot can go back to EMPTY; otherwise it has to become a tombstone.
+    size_t group = slot & ~(GROUP_WIDTH - 1);
+    if (Group(&ctrl()[group]).matchEmpty()) {
+        setCtrl(slot, EMPTY);
+        ++growthLeft;
+    } else {
+        setCtrl(slot, DELETED);
+    }
+    --count;
+}
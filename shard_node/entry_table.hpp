@@ -0,0 +1,239 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "entry.hpp"
+
+// Open-addressing hash set of entries in the style of a Swiss table. A
+// parallel array of control bytes holds, per slot, EMPTY, DELETED, or the
+// low 7 bits of the key's hash. Lookups compare a group of 16 control
+// bytes against those bits at once (SSE2 where available) and only touch
+// the slots, and their keys, that match. Groups are probed quadratically.
+//
+// Offers the subset of std::unordered_set that KVStore uses, including
+// one-slot "buckets" for random sampling. Writers and locked readers need
+// external locking. tryRead() needs none: every change is bracketed by a
+// seqlock version, and entry blocks and slot arrays that a change drops
+// are retired to EpochReclaimer rather than freed.
+class EntryTable {
+    private:
+        static constexpr size_t GROUP_WIDTH = 16;
+        static constexpr int8_t EMPTY = -128;
+        static constexpr int8_t DELETED = -2;
+
+        // Capacity, control bytes and slots in one allocation, so a reader
+        // that loads the pointer sees arrays that match their size
+        struct Storage {
+            size_t capacity; // A multiple of GROUP_WIDTH, power of two
+            int8_t* ctrl() { return reinterpret_cast<int8_t*>(this + 1); }
+            const int8_t* ctrl() const { return reinterpret_cast<const int8_t*>(this + 1); }
+            // Empty slots hold a null Entry
+            Entry* slots() { return reinterpret_cast<Entry*>(ctrl() + capacity); }
+            const Entry* slots() const { return reinterpret_cast<const Entry*>(ctrl() + capacity); }
+
+            static Storage* allocate(size_t capacity);
+            static void destroy(void* storage) { ::operator delete(storage); }
+            static size_t bytes(size_t capacity) { return sizeof(Storage) + capacity * (1 + sizeof(Entry)); }
+        };
+
+        std::atomic<Storage*> storage{nullptr};
+        size_t capacity = 0;   // Copy of storage->capacity for writers
+        size_t count = 0;
+        size_t growthLeft = 0; // EMPTY slots we may still fill
+        // Odd while a change is under way
+        std::atomic<uint64_t> version{0};
+
+        // One group of control bytes; matches come back as a bit per slot
+        class Group {
+            private:
+#if defined(__SSE2__)
+                __m128i bytes;
+            public:
+                explicit Group(const int8_t* p) : bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+                uint32_t match(int8_t h2) const {
+                    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), bytes));
+                }
+                uint32_t matchEmpty() const { return match(EMPTY); }
+                // EMPTY and DELETED are the only bytes with the top bit set
+                uint32_t matchFree() const { return _mm_movemask_epi8(bytes); }
+#else
+                const int8_t* bytes;
+                template <typename Pred>
+                uint32_t matchIf(Pred pred) const {
+                    uint32_t mask = 0;
+                    for (size_t i = 0; i < GROUP_WIDTH; ++i) mask |= uint32_t{pred(bytes[i])} << i;
+                    return mask;
+                }
+            public:
+                explicit Group(const int8_t* p) : bytes(p) {}
+                uint32_t match(int8_t h2) const { return matchIf([h2](int8_t c) { return c == h2; }); }
+                uint32_t matchEmpty() const { return match(EMPTY); }
+                uint32_t matchFree() const { return matchIf([](int8_t c) { return c < 0; }); }
+#endif
+        };
+
+        // Marks the table as changing for the lifetime of the object
+        class WriteSection {
+            private:
+                std::atomic<uint64_t>& version;
+            public:
+                explicit WriteSection(std::atomic<uint64_t>& version) : version(version) {
+                    version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_release);
+                }
+                ~WriteSection() { version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+        };
+
+        // Spreads the bits: partitions and slices already pick by parts of
+        // the same hash, so keys in one table would otherwise share them
+        static uint64_t mix(uint64_t hash) {
+            hash ^= hash >> 33;
+            hash *= 0xff51afd7ed558ccdull;
+            return hash ^ (hash >> 33);
+        }
+        static int8_t h2(uint64_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+        static size_t firstGroup(uint64_t hash, size_t capacity) {
+            return (hash >> 7) & (capacity - 1) & ~(GROUP_WIDTH - 1);
+        }
+
+        Storage* current() const { return storage.load(std::memory_order_relaxed); }
+        int8_t* ctrl() const { return current()->ctrl(); }
+        Entry* slots() const { return current()->slots(); }
+        size_t findSlot(std::string_view key, uint64_t hash) const;
+        static const char* findBlock(const Storage& s, std::string_view key, uint64_t hash);
+        size_t findFreeSlot(uint64_t hash) const;
+        void setCtrl(size_t slot, int8_t value) { ctrl()[slot] = value; }
+        void setSlot(size_t slot, Entry&& entry);
+        void retire(Entry& entry);
+        void rehash(size_t newCapacity);
+        static size_t capacityFor(size_t entries);
+
+    public:
+        // Iterates full slots; also serves as the local iterator of a slot
+        class const_iterator {
+            private:
+                const EntryTable* table = nullptr;
+                size_t slot = 0;
+                friend class EntryTable;
+                void skipFree() {
+                    while (slot < table->capacity && table->ctrl()[slot] < 0) ++slot;
+                }
+            public:
+                const_iterator() = default;
+                const_iterator(const EntryTable* table, size_t slot) : table(table), slot(slot) {}
+                const Entry& operator*() const { return table->slots()[slot]; }
+                const Entry* operator->() const { return &table->slots()[slot]; }
+                const_iterator& operator++() {
+                    ++slot;
+                    skipFree();
+                    return *this;
+                }
+                bool operator==(const const_iterator& other) const { return slot == other.slot; }
+        };
+        using iterator = const_iterator;
+
+        EntryTable() = default;
+        EntryTable(const EntryTable&) = delete;
+        EntryTable& operator=(const EntryTable&) = delete;
+        ~EntryTable();
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        void reserve(size_t entries);
+
+        const_iterator begin() const {
+            const_iterator it(this, 0);
+            if (capacity) it.skipFree();
+            return it;
+        }
+        const_iterator end() const { return const_iterator(this, capacity); }
+
+        // `hash` is EntryHash of the key, for callers that already have it
+        const_iterator find(std::string_view key, size_t hash) const {
+            if (count == 0) return end();
+            return const_iterator(this, findSlot(key, mix(hash)));
+        }
+        const_iterator find(std::string_view key) const { return find(key, EntryHash{}(key)); }
+        // Inserts unless the key is present; `entry` is only moved from if
+        // it was inserted
+        std::pair<const_iterator, bool> insert(Entry&& entry, size_t hash);
+        std::pair<const_iterator, bool> insert(Entry&& entry) { return insert(std::move(entry), EntryHash{}(entry)); }
+        // Swaps in an entry for the same key
+        void replace(const_iterator it, Entry&& entry);
+        void erase(const_iterator it);
+
+        // Lookup without a lock, for a caller holding an
+        // EpochReclaimer::Guard. Calls read() with the key's entry, or null,
+        // and returns whether no change overlapped it; if one did, what
+        // read() saw may be inconsistent and has to be thrown away.
+        template <typename Read>
+        bool tryRead(std::string_view key, size_t hash, Read&& read) const;
+
+        // Each slot as a bucket of zero or one entries
+        size_t bucket_count() const { return capacity; }
+        const Entry* begin(size_t slot) const { return &slots()[slot]; }
+        const Entry* end(size_t slot) const { return &slots()[slot] + (ctrl()[slot] >= 0); }
+};
+
+// The slot holding `key`, or capacity if there is none
+inline size_t EntryTable::findSlot(std::string_view key, uint64_t hash) const {
+    const int8_t* ctrl = this->ctrl();
+    const Entry* slots = this->slots();
+    size_t groupMask = capacity - 1;
+    size_t group = firstGroup(hash, capacity);
+    for (size_t step = GROUP_WIDTH;; step += GROUP_WIDTH) {
+        Group g(&ctrl[group]);
+        for (uint32_t match = g.match(h2(hash)); match; match &= match - 1) {
+            size_t slot = group + std::countr_zero(match);
+            if (slots[slot].getKey() == key) return slot;
+        }
+        // A key is never placed past a group that had room
+        if (g.matchEmpty()) return capacity;
+        group = (group + step) & groupMask;
+    }
+}
+
+// findSlot() for a reader racing writers: each block pointer is loaded
+// once, and the probe gives up after visiting every group, since a table
+// changing underneath may never show it an EMPTY slot
+inline const char* EntryTable::findBlock(const Storage& s, std::string_view key, uint64_t hash) {
+    const int8_t* ctrl = s.ctrl();
+    Entry* slots = const_cast<Storage&>(s).slots();
+    size_t groupMask = s.capacity - 1;
+    size_t group = firstGroup(hash, s.capacity);
+    for (size_t step = GROUP_WIDTH; step <= s.capacity; step += GROUP_WIDTH) {
+        Group g(&ctrl[group]);
+        for (uint32_t match = g.match(h2(hash)); match; match &= match - 1) {
+            size_t slot = group + std::countr_zero(match);
+            const char* block = std::atomic_ref<const char*>(slots[slot].block).load(std::memory_order_acquire);
+            if (block && EntryView(block).getKey() == key) return block;
+        }
+        if (g.matchEmpty()) break;
+        group = (group + step) & groupMask;
+    }
+    return nullptr;
+}
+
+template <typename Read>
+bool EntryTable::tryRead(std::string_view key, size_t hash, Read&& read) const {
+    uint64_t before = version.load(std::memory_order_acquire);
+    if (before & 1) return false;
+    const Storage* s = storage.load(std::memory_order_acquire);
+    const char* block = s ? findBlock(*s, key, mix(hash)) : nullptr;
+    if (block) {
+        EntryView entry(block);
+        read(&entry);
+    } else {
+        read(static_cast<const EntryView*>(nullptr));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version.load(std::memory_order_relaxed) == before;
+}
@@ -0,0 +1,150 @@
+#include "epoch_reclaimer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// A thread reclaims once it holds this much retired memory
+constexpr size_t RECLAIM_COUNT = 64;
+constexpr size_t RECLAIM_BYTES = 1 << 20;
+
+struct Retired {
+    void* ptr;
+    void (*destroy)(void*);
+    size_t bytes;
+    uint64_t epoch;
+};
+
+// One per thread that has pinned, on its own cache line; reused after the
+// thread exits. pinned is the epoch held, or 0.
+struct alignas(64) ThreadRecord {
+    std::atomic<uint64_t> pinned{0};
+    std::atomic<bool> inUse{false};
+    ThreadRecord* next = nullptr;
+};
+
+struct Domain {
+    std::atomic<uint64_t> epoch{1};
+    std::atomic<ThreadRecord*> records{nullptr}; // Only grows
+    std::mutex orphanMutex;
+    std::vector<Retired> orphans; // Left by threads that exited
+};
+
+// Never destroyed, so threads exiting during static destruction can still
+// hand over what they retired
+Domain& domain() {
+    static Domain* instance = new Domain;
+    return *instance;
+}
+
+ThreadRecord* acquireRecord() {
+    Domain& d = domain();
+    for (ThreadRecord* r = d.records.load(std::memory_order_acquire); r; r = r->next) {
+        bool free = false;
+        if (!r->inUse.load(std::memory_order_relaxed) &&
+            r->inUse.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+            return r;
+        }
+    }
+    auto* r = new ThreadRecord;
+    r->inUse.store(true, std::memory_order_relaxed);
+    r->next = d.records.load(std::memory_order_relaxed);
+    while (!d.records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return r;
+}
+
+struct ThreadState {
+    ThreadRecord* record = nullptr;
+    unsigned depth = 0; // Nested guards
+    std::vector<Retired> retired;
+    size_t retiredBytes = 0;
+    size_t reclaimAt = RECLAIM_COUNT;
+
+    ~ThreadState() {
+        if (!retired.empty()) {
+            Domain& d = domain();
+            std::lock_guard<std::mutex> lock(d.orphanMutex);
+            d.orphans.insert(d.orphans.end(), retired.begin(), retired.end());
+        }
+        if (record) {
+            record->pinned.store(0, std::memory_order_release);
+            record->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadState state;
+
+// Moves the epoch on by one if every pinned reader has seen the current one
+void tryAdvance() {
+    Domain& d = domain();
+    uint64_t epoch = d.epoch.load(std::memory_order_seq_cst);
+    for (ThreadRecord* r = d.records.load(std::memory_order_acquire); r; r = r->next) {
+        uint64_t pinned = r->pinned.load(std::memory_order_seq_cst);
+        if (pinned != 0 && pinned != epoch) return;
+    }
+    d.epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+}
+
+// Frees the entries retired at least two epochs ago; returns the bytes kept
+size_t freeUnreachable(std::vector<Retired>& list, uint64_t epoch) {
+    size_t kept = 0;
+    auto keep = std::partition(list.begin(), list.end(), [epoch](const Retired& r) { return r.epoch + 2 > epoch; });
+    for (auto it = list.begin(); it != keep; ++it) kept += it->bytes;
+    for (auto it = keep; it != list.end(); ++it) it->destroy(it->ptr);
+    list.erase(keep, list.end());
+    return kept;
+}
+
+} // namespace
+
+void EpochReclaimer::pin() {
+    if (state.depth++ > 0) return;
+    if (!state.record) state.record = acquireRecord();
+    // Re-check after publishing: a reclaimer that scanned before the pin
+    // was visible may have advanced past the epoch read
+    Domain& d = domain();
+    uint64_t epoch = d.epoch.load(std::memory_order_seq_cst);
+    while (true) {
+        state.record->pinned.store(epoch, std::memory_order_seq_cst);
+        uint64_t current = d.epoch.load(std::memory_order_seq_cst);
+        if (current == epoch) break;
+        epoch = current;
+    }
+}
+
+void EpochReclaimer::unpin() {
+    if (--state.depth == 0) {
+        state.record->pinned.store(0, std::memory_order_release);
+    }
+}
+
+void EpochReclaimer::retire(void* ptr, void (*destroy)(void*), size_t bytes) {
+    state.retired.push_back({ptr, destroy, bytes, domain().epoch.load(std::memory_order_seq_cst)});
+    state.retiredBytes += bytes;
+    if (state.retired.size() >= state.reclaimAt || state.retiredBytes >= RECLAIM_BYTES) {
+        reclaim();
+    }
+}
+
+void EpochReclaimer::reclaim() {
+    // Two steps make this thread's latest retirements freeable when no
+    // reader is pinned
+    tryAdvance();
+    tryAdvance();
+    Domain& d = domain();
+    uint64_t epoch = d.epoch.load(std::memory_order_seq_cst);
+    state.retiredBytes = freeUnreachable(state.retired, epoch);
+    // Readers that stay pinned keep memory back; don't rescan on every retire
+    state.reclaimAt = state.retired.size() + RECLAIM_COUNT;
+
+    std::unique_lock<std::mutex> lock(d.orphanMutex, std::try_to_lock);
+    if (lock.owns_lock() && !d.orphans.empty()) {
+        freeUnreachable(d.orphans, epoch);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+// Epoch-based reclamation for memory that lock-free readers may still be
+// looking at. A reader pins the current epoch for the duration of its
+// lookup by holding a Guard, which writes only to its own thread's record.
+// Writers retire memory instead of freeing it; it is freed once the global
+// epoch has moved two past the one it was retired in, which every pinned
+// reader holds back, so no reader can still reach it.
+//
+// Process-wide: all stores and threads share one epoch.
+class EpochReclaimer {
+    private:
+        static void pin();
+        static void unpin();
+
+    public:
+        class Guard {
+            public:
+                Guard() { pin(); }
+                ~Guard() { unpin(); }
+                Guard(const Guard&) = delete;
+                Guard& operator=(const Guard&) = delete;
+        };
+
+        // Frees `ptr` with `destroy` once no reader can hold it. `bytes`
+        // only counts towards when the calling thread next reclaims.
+        static void retire(void* ptr, void (*destroy)(void*), size_t bytes);
+
+        // Advances the epoch if no reader holds it back and frees what has
+        // become unreachable, from this thread and exited ones
+        static void reclaim();
+};
@@ -1,25 +1,187 @@
 #include "kvstore.hpp"
+#include "coarse_clock.hpp"
+#include "epoch_reclaimer.hpp"
+#include "snapshot.hpp"
 #include "wal.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <thread>
 
+#include <time.h>
+
+namespace {
+
+constexpr const char* TEXT_SNAPSHOT_MAGIC = "KVSNAP";
+constexpr const char* DELTA_TAG = ".delta.";
+constexpr size_t LSN_DIGITS = 20;
+
+// Delta snapshots sit beside the full one, named by the LSN they cover
+std::string deltaSnapshotPath(const std::string& snapshotFile, uint64_t lsn) {
+    char digits[LSN_DIGITS + 1];
+    std::snprintf(digits, sizeof(digits), "%020llu", static_cast<unsigned long long>(lsn));
+    return snapshotFile + DELTA_TAG + digits;
+}
+
+// TTL deadlines live on steady_clock in memory, so wall-clock adjustments
+// don't move them while running, and are persisted as system_clock
+// milliseconds since the Unix epoch, which still mean the same instant
+// after a restart or reboot. Scans take the offset between the clocks once
+// rather than reading both per key.
+std::chrono::nanoseconds wallClockOffset() {
+    return std::chrono::system_clock::now().time_since_epoch() -
+           std::chrono::steady_clock::now().time_since_epoch();
+}
+
+int64_t toWallClockMs(std::chrono::steady_clock::time_point deadline,
+                      std::chrono::nanoseconds offset = wallClockOffset()) {
+    auto wallClock = std::chrono::duration_cast<std::chrono::milliseconds>(deadline.time_since_epoch() + offset);
+    return std::max<int64_t>(wallClock.count(), 1); // 0 means no TTL
+}
+
+// The steady_clock deadline for a persisted one, or nullopt if it has passed
+std::optional<std::chrono::steady_clock::time_point> fromWallClockMs(
+        uint64_t wallClockMs, std::chrono::nanoseconds offset = wallClockOffset(),
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) {
+    auto wallClockNow = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch() + offset);
+    auto remaining = std::chrono::milliseconds(wallClockMs) - wallClockNow;
+    if (remaining.count() <= 0) return std::nullopt;
+    return now + remaining;
+}
+
+// A stored value as get() returns it
+std::string readValue(const EntryView& entry) {
+    if (entry.isCompressed()) return ValueCodec::decompress(entry.getValue());
+    return std::string(entry.getValue());
+}
+
+// Values loaded from disk may have been compressed by a build with other
+// codecs; better to refuse to open than to fail their gets
+void checkCompressedValue(std::string_view key, std::string_view value) {
+    if (!ValueCodec::canDecompress(value)) {
+        throw std::runtime_error("Value of key " + std::string(key) + " is compressed with a codec this build lacks");
+    }
+}
+
+// Access words for eviction, relative to EntryView::EPOCH. LRU keeps the
+// ms of the last use, wrapping after about 49 days; LFU keeps the minute of
+// the last use in the top 24 bits and the hit counter in the low 8.
+constexpr uint32_t LFU_INITIAL = 5; // So new keys aren't the first to go
+// LRU restamps a key at most this often, so a hot key's access word isn't
+// written (and its cache line taken from every other reader) on each get
+constexpr uint32_t LRU_TOUCH_INTERVAL_MS = 10;
+
+uint32_t accessClockMs(std::chrono::steady_clock::time_point now) {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - EntryView::EPOCH).count());
+}
+
+uint32_t accessClockMinutes(std::chrono::steady_clock::time_point now) {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::minutes>(now - EntryView::EPOCH).count()) &
+           0xFFFFFF;
+}
+
+// The LFU counter less one for every decayMinutes the key went unused
+uint32_t lfuCounter(uint32_t access, uint32_t nowMinutes, size_t decayMinutes) {
+    uint32_t counter = access & 0xFF;
+    if (decayMinutes == 0) return counter;
+    uint32_t periods = ((nowMinutes - (access >> 8)) & 0xFFFFFF) / decayMinutes;
+    return periods >= counter ? 0 : counter - periods;
+}
+
+// Readers and writers of every store draw from it, so one per thread
+std::minstd_rand& threadRandom() {
+    thread_local std::minstd_rand random(std::random_device{}());
+    return random;
+}
+
+std::chrono::microseconds threadCpuTime() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) +
+           std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(ts.tv_nsec));
+}
+
+} // namespace
+
 //
-// KVStore::Value definitions
+// Slices
 //
-KVStore::Value::Value() : value(""), expiration(std::nullopt) {}
+KVStore::Slice& KVStore::sliceFor(const HashedKey& key) {
+    // Partitions pick by the low bits of the same hash; take the top bits
+    // of a multiplicative mix so a partition's keys still spread out
+    uint64_t hash = key.hash * 0x9E3779B97F4A7C15ull;
+    return slices[hash >> (64 - std::bit_width(SLICE_COUNT - 1))];
+}
 
-KVStore::Value::Value(const std::string& val)
-    : value(val), expiration(std::nullopt) {}
+auto KVStore::findKey(const Slice& slice, const HashedKey& key) {
+#ifdef KV_SWISS_TABLE
+    return slice.entries.find(key.view, key.hash);
+#else
+    // std::unordered_set has no lookup by a precomputed hash
+    return slice.entries.find(key.view);
+#endif
+}
 
-KVStore::Value::Value(const std::string& val, std::chrono::steady_clock::time_point exp)
-    : value(val), expiration(exp) {}
+size_t KVStore::entryCount() {
+    size_t count = 0;
+    for (auto& slice : slices) {
+        std::shared_lock lock(slice.mutex);
+        count += slice.entries.size();
+    }
+    return count;
+}
 
-bool KVStore::Value::isExpired() const {
-    return expiration.has_value() &&
-           std::chrono::steady_clock::now() >= expiration.value();
+void KVStore::reserve(size_t entries) {
+    for (auto& slice : slices) slice.entries.reserve(entries / SLICE_COUNT + 1);
+}
+
+// Inserts the entry, replacing any with the same key. Called with the
+// slice's exclusive lock held.
+void KVStore::upsert(Slice& slice, Entry&& entry, size_t hash) {
+    // Neither set moves from the entry unless it inserts it
+#ifdef KV_SWISS_TABLE
+    auto [it, inserted] = slice.entries.insert(std::move(entry), hash);
+#else
+    (void)hash;
+    auto [it, inserted] = slice.entries.insert(std::move(entry));
+#endif
+    if (inserted) return;
+    // A put without a TTL leaves nothing for the key's wheel entry to expire
+    if (it->hasExpiration() && !entry.hasExpiration()) cancelExpiry(entry.getKey());
+    replaceEntry(slice, it, std::move(entry));
+}
+
+// Swaps in an entry for the same key. Called with the slice's exclusive
+// lock held.
+void KVStore::replaceEntry(Slice& slice, SliceIterator it, Entry&& entry) {
+#ifdef KV_SWISS_TABLE
+    // Lock-free readers may still hold the old block
+    slice.entries.replace(it, std::move(entry));
+#else
+    // Set elements are const so their hash can't change; the key stays
+    // the same, so swapping in the new block is safe
+    (void)slice;
+    const_cast<Entry&>(*it) = std::move(entry);
+#endif
+}
+
+void KVStore::eraseKey(Slice& slice, const HashedKey& key) {
+    auto it = findKey(slice, key);
+    if (it == slice.entries.end()) return;
+    if (it->hasExpiration()) cancelExpiry(key.view);
+    slice.entries.erase(it);
+}
+
+// Called with the slice's exclusive lock held
+void KVStore::trackChange(Slice& slice, std::string_view key) {
+    if (trackChanges && slice.dirty.find(key) == slice.dirty.end()) slice.dirty.emplace(key);
 }
 
 //
@@ -27,13 +189,40 @@ bool KVStore::Value::isExpired() const {
 //
 KVStore::KVStore() = default;
 
-KVStore::KVStore(const std::string& logFile)
-    : wal(std::make_unique<WriteAheadLog>(logFile)) {
+KVStore::KVStore(const std::string& logFile, const KVStoreOptions& options)
+    : options(options) {
+    if (!ValueCodec::isAvailable(options.valueCompression)) {
+        throw std::runtime_error(std::string("Value compression ") + ValueCodec::name(options.valueCompression) +
+                                 " is not built in");
+    }
+    if (!ValueCodec::isAvailable(options.snapshotCompression)) {
+        throw std::runtime_error(std::string("Snapshot compression ") + ValueCodec::name(options.snapshotCompression) +
+                                 " is not built in");
+    }
+    trackChanges = options.deltaSnapshotsPerFull > 0;
+    trackAccess = options.maxMemoryBytes > 0 && options.evictionPolicy != EvictionPolicy::VolatileTTL;
     snapshotFileName = logFile + ".snapshot";
+    auto start = std::chrono::steady_clock::now();
+    uint64_t snapshotLSN = 0;
     if (!snapshotFileName.empty()) {
-        loadSnapshot(snapshotFileName);
+        snapshotLSN = loadSnapshot(snapshotFileName);
     }
-    recoverFromWAL(logFile);
+    recoveryStats.snapshotEntries = entryCount();
+    auto loaded = std::chrono::steady_clock::now();
+
+    // Only records newer than the snapshot are replayed; new LSNs continue
+    // above both
+    auto recovered = recoverFromWAL(logFile, snapshotLSN);
+    recovered.lastLSN = std::max(recovered.lastLSN, snapshotLSN);
+    wal = std::make_unique<WriteAheadLog>(logFile, options.wal, &recovered);
+    auto replayed = std::chrono::steady_clock::now();
+
+    recoveryStats.walRecords = recovered.records;
+    recoveryStats.snapshotLoad = std::chrono::duration_cast<std::chrono::microseconds>(loaded - start);
+    recoveryStats.walReplay = std::chrono::duration_cast<std::chrono::microseconds>(replayed - loaded);
+
+    // A limit lowered since the data was written applies from the start
+    if (options.maxMemoryBytes > 0 && memoryUsed() > options.maxMemoryBytes) evict();
 }
 
 void KVStore::startBackgroundThreads() {
@@ -41,7 +230,7 @@ void KVStore::startBackgroundThreads() {
     cleaner = std::thread([this]() {
     std::unique_lock<std::mutex> lock(cleanerMutex);
         while (!stopFlag.load()) {
-            if (cleanerCV.wait_for(lock, std::chrono::seconds(1)) == std::cv_status::timeout) {
+            if (cleanerCV.wait_for(lock, std::chrono::milliseconds(options.cleanupIntervalMs)) == std::cv_status::timeout) {
                 cleanup_expired_keys();
             }
         }
@@ -50,7 +239,7 @@ void KVStore::startBackgroundThreads() {
     snapshotThread = std::thread([this]() {
         std::unique_lock<std::mutex> lock(snapshotMutex);
         while (!stopFlag.load()) {
-            if (snapshotCV.wait_for(lock, std::chrono::seconds(snapshotIntervalSeconds)) == std::cv_status::timeout) {
+            if (snapshotCV.wait_for(lock, std::chrono::seconds(options.snapshotIntervalSeconds)) == std::cv_status::timeout) {
                 snapshot(snapshotFileName);
             }
         }
@@ -58,122 +247,359 @@ void KVStore::startBackgroundThreads() {
 
 }
 
+// Applies a mutation under the slice's write lock and logs its pre-encoded
+// record. Only the WAL sequence number is taken inside the lock, which keeps
+// each key's records in the same order as its updates; the record is handed
+// to the WAL and the commit awaited after the lock is released.
+template <typename Mutation>
+void KVStore::applyLogged(Slice& slice, EncodedRecord record, Durability durability, Mutation&& mutate) {
+    uint64_t sequence = 0;
+    {
+        std::unique_lock lock(slice.mutex);
+        mutate();
+        if (wal)
+            sequence = wal->reserveSequence();
+    }
+    if (wal) {
+        wal->submit(sequence, std::move(record));
+        wal->waitFor(sequence, durability);
+    }
+}
+
 //
 // Public API methods
 //
 std::unique_ptr<KVStore> KVStore::create(const std::string& logFile) {
-    auto kvstore = std::unique_ptr<KVStore>(new KVStore(logFile));
-    kvstore->startBackgroundThreads();
+    return create(logFile, KVStoreOptions{});
+}
+
+std::unique_ptr<KVStore> KVStore::create(const std::string& logFile, const KVStoreOptions& options) {
+    auto kvstore = std::unique_ptr<KVStore>(new KVStore(logFile, options));
+    if (options.backgroundThreads) {
+        kvstore->startBackgroundThreads();
+    }
     return kvstore;
 }
-void KVStore::put(const std::string& key, const std::string& value) {
-    std::unique_lock lock(mutex);
-    Value val(value);
-    store[key] = std::move(val);
-    if (wal)
-        wal->appendBatch("PUT " + key + " " + value);
+
+void KVStore::put(const HashedKey& key, PutValue value) {
+    put(key, std::move(value), options.durability);
+}
+
+void KVStore::put(const HashedKey& key, PutValue value, Durability durability) {
+    putEntry(key, std::move(value), std::nullopt, durability);
+}
+
+void KVStore::put(const HashedKey& key, PutValue value, int ttl_ms) {
+    put(key, std::move(value), ttl_ms, options.durability);
+}
+
+void KVStore::put(const HashedKey& key, PutValue value, int ttl_ms, Durability durability) {
+    putEntry(key, std::move(value), CoarseClock::now() + std::chrono::milliseconds(ttl_ms), durability);
 }
 
-void KVStore::put(const std::string& key, const std::string& value, int ttl_ms) {
-    auto expiration = std::chrono::steady_clock::now() + std::chrono::milliseconds(ttl_ms);
-    std::unique_lock lock(mutex);
-    Value val(value, expiration);
-    store[key] = std::move(val);
-    if (wal)
-        wal->appendBatch("PUT " + key + " " + value + " " + std::to_string(ttl_ms));
+// Compresses the value if the store compresses values its size, then
+// encodes the record and builds the entry before taking the write lock. A
+// large value is kept once, in a buffer the entry and the record share.
+void KVStore::putEntry(const HashedKey& key, PutValue value,
+                       std::optional<std::chrono::steady_clock::time_point> expiration, Durability durability) {
+    int64_t expiryMs = expiration ? toWallClockMs(*expiration) : 0;
+    auto compressed = compressValue(value.view());
+    bool isCompressed = compressed.has_value();
+    PutValue stored = isCompressed ? PutValue(std::move(*compressed)) : std::move(value);
+    WALOp op = isCompressed ? WALOp::PutCompressed : WALOp::Put;
+    EncodedRecord record;
+    Entry entry;
+    if (stored.view().size() >= SHARED_VALUE_MIN) {
+        SharedValue shared = std::move(stored).share();
+        if (wal) record = WriteAheadLog::encodeRecord(op, key.view, shared, expiryMs);
+        entry = Entry(key.view, std::move(shared), expiration, slabs.get(), initialAccess(), isCompressed);
+    } else {
+        if (wal) record = WriteAheadLog::encodeRecord(op, key.view, stored.view(), expiryMs);
+        entry = Entry(key.view, stored.view(), expiration, slabs.get(), initialAccess(), isCompressed);
+    }
+    auto deadline = entry.getExpiration(); // As stored, which cleanup matches against
+    Slice& slice = sliceFor(key);
+    applyLogged(slice, std::move(record), durability, [&] {
+        if (trackAccess && options.evictionPolicy == EvictionPolicy::LFU) {
+            // An overwrite counts as one more use of the key
+            auto it = findKey(slice, key);
+            if (it != slice.entries.end()) {
+                entry.setAccess(it->getAccess());
+                touch(entry);
+            }
+        }
+        upsert(slice, std::move(entry), key.hash);
+        trackChange(slice, key.view);
+        if (deadline) scheduleExpiry(key.view, *deadline);
+    });
+    if (options.maxMemoryBytes > 0 && memoryUsed() > options.maxMemoryBytes) evict();
 }
 
-std::optional<std::string> KVStore::get(const std::string& key) {
-    std::shared_lock lock(mutex);
-    auto it = store.find(key);
-    if (it != store.end() && !it->second.isExpired()) {
-        return it->second.value;
+std::optional<std::string> KVStore::get(const HashedKey& key) {
+    Slice& slice = sliceFor(key);
+#ifdef KV_SWISS_TABLE
+    // Optimistically first: no lock, and nothing written that other threads
+    // read except, with LRU or LFU eviction, the key's access word now and
+    // then (see touch()). Only a write to the same slice in the middle of it
+    // forces a retry.
+    {
+        EpochReclaimer::Guard guard;
+        for (int attempt = 0; attempt < OPTIMISTIC_READ_ATTEMPTS; ++attempt) {
+            std::optional<std::string> value;
+            bool compressed = false;
+            bool consistent = slice.entries.tryRead(key.view, key.hash, [&](const EntryView* entry) {
+                if (entry && !entry->isExpired(CoarseClock::now())) {
+                    value.emplace(entry->getValue());
+                    compressed = entry->isCompressed();
+                    touch(*entry);
+                }
+            });
+            // Decompressed once the read is known to be good, so a retry
+            // only wasted a copy
+            if (consistent && value && compressed) return ValueCodec::decompress(*value);
+            if (consistent) return value;
+        }
+    }
+#endif
+    // Writers keep getting in the way; wait for them
+    std::shared_lock lock(slice.mutex);
+    auto it = findKey(slice, key);
+    if (it != slice.entries.end() && !it->isExpired(CoarseClock::now())) {
+        touch(*it);
+        return readValue(*it);
     }
     return std::nullopt;
 }
 
-void KVStore::remove(const std::string& key) {
-    std::unique_lock lock(mutex);
-    if (wal)
-        wal->appendBatch("REMOVE " + key);
-    store.erase(key);
+void KVStore::remove(const HashedKey& key) {
+    remove(key, options.durability);
+}
+
+void KVStore::remove(const HashedKey& key, Durability durability) {
+    EncodedRecord record = wal ? WriteAheadLog::encodeRecord(WALOp::Remove, key.view) : std::string();
+    Slice& slice = sliceFor(key);
+    applyLogged(slice, std::move(record), durability, [&] {
+        eraseKey(slice, key);
+        trackChange(slice, key.view);
+    });
 }
 
 //
 // Internal methods
 //
 
-void KVStore::recoverFromWAL(const std::string& filename) {
-    std::ifstream infile(filename);
-    std::string line;
-    while (std::getline(infile, line)) {
-        std::istringstream iss(line);
-        std::string op, key, value;
-        if (!(iss >> op >> key)) continue;
-
-        if (op == "PUT") {
-            iss >> value;
-            std::unique_lock lock(mutex);
-            Value val(value);
-            store[key] = std::move(val);
-        } else if (op == "PUT_TTL") {
-            long long expiry_epoch;
-            if (iss >> value >> expiry_epoch) {
-                auto expiry_time = std::chrono::steady_clock::time_point{
-                    std::chrono::milliseconds(expiry_epoch)
-                };
-                std::unique_lock lock(mutex);
-                Value val(value, expiry_time);
-                store[key] = std::move(val);
+// Recovery runs from the constructor, before the store is visible to any
+// other thread, so neither the replay nor the snapshot load takes the lock.
+// Replayed keys are marked dirty: no snapshot holds them yet, and the next
+// delta has to before the segments they came from can be retired.
+WALReplayResult KVStore::recoverFromWAL(const std::string& filename, uint64_t afterLSN) {
+    auto offset = wallClockOffset();
+    auto now = std::chrono::steady_clock::now();
+    return WriteAheadLog::replay(filename, [this, offset, now](const WALRecord& record) {
+        HashedKey key(record.key);
+        Slice& slice = sliceFor(key);
+        bool compressed = record.op == WALOp::PutCompressed;
+        if (compressed) checkCompressedValue(key.view, record.value);
+        if (record.op == WALOp::Remove) {
+            eraseKey(slice, key);
+        } else if (record.expiryMs > 0) {
+            // A put whose TTL ran out while we were down still replaces the
+            // older value, so the key ends up absent rather than inserted
+            auto expiration = fromWallClockMs(record.expiryMs, offset, now);
+            if (expiration) {
+                Entry entry(key.view, record.value, *expiration, slabs.get(), initialAccess(), compressed);
+                scheduleExpiry(key.view, *entry.getExpiration());
+                upsert(slice, std::move(entry), key.hash);
             } else {
-                std::cerr << "[WAL Recovery] Bad PUT_TTL line: " << line << "\n";
+                eraseKey(slice, key);
             }
-        } else if (op == "REMOVE") {
-            std::unique_lock lock(mutex);
-            store.erase(key);
+        } else {
+            upsert(slice, Entry(key.view, record.value, std::nullopt, slabs.get(), initialAccess(), compressed),
+                   key.hash);
         }
-    }
+        trackChange(slice, key.view);
+    }, afterLSN);
 }
 
 void KVStore::snapshot(const std::string& filename) {
-    // Reduced verbosity - only log snapshots occasionally
-    // std::cout << "Creating snapshot: " << filename << "\n";
-    std::string tmpFilename = filename + ".tmp";
-    std::ofstream out(tmpFilename);
-    if (!out.is_open()) {
-        throw std::runtime_error("Failed to open snapshot file: " + tmpFilename);
+    // One snapshot at a time: a delta takes over the dirty sets it writes
+    std::lock_guard<std::mutex> checkpoint(checkpointMutex);
+
+    // A fuzzy snapshot: slices are encoded one at a time under their shared
+    // lock and written out after it is released, so writers wait for at
+    // most one slice and never for disk I/O. Writers apply their update
+    // before reserving its LSN under the slice's exclusive lock, so every key's
+    // image is at least as new as startLSN. Each record sets or removes a
+    // whole key, so replaying the records after startLSN on top of the
+    // image reproduces the exact state.
+    uint64_t startLSN = wal ? wal->getLastLSN() : 0;
+
+    size_t changed = 0;
+    size_t entries = 0;
+    for (auto& slice : slices) {
+        std::shared_lock lock(slice.mutex);
+        changed += slice.dirty.size();
+        entries += slice.entries.size();
     }
-    {
-        std::shared_lock lock(mutex);
-        for (const auto& [key, val] : store) {
-            if (val.isExpired()) continue;
-
-            out << key << '\t' << val.value << '\t';
-            if (val.expiration.has_value()) {
-                out << std::chrono::duration_cast<std::chrono::milliseconds>(
-                        val.expiration->time_since_epoch()).count();
+    if (trackChanges && !fullSnapshotPending && changed == 0) {
+        return; // Nothing changed since the last snapshot
+    }
+    // Consolidate once the chain is long, or when most keys changed anyway
+    bool full = !trackChanges || fullSnapshotPending ||
+                deltaChainLength >= options.deltaSnapshotsPerFull || changed * 2 >= entries;
+
+    // If this snapshot fails after taking over dirty sets, those keys are
+    // in no file, so until one succeeds the next snapshot has to be full
+    fullSnapshotPending = true;
+
+    std::string target = full ? filename : deltaSnapshotPath(filename, startLSN);
+    std::string tmpFilename = target + ".tmp";
+    SnapshotWriter writer(tmpFilename, full ? SnapshotKind::Full : SnapshotKind::Delta, options.snapshotCompression);
+    KeySet dirty;
+    for (auto& slice : slices) {
+        {
+            // Writers only touch the dirty sets under the exclusive lock and
+            // snapshots are serialized, so the shared lock is enough
+            std::shared_lock lock(slice.mutex);
+            auto offset = wallClockOffset();
+            dirty.swap(slice.dirty);
+            if (full) {
+                auto now = CoarseClock::now();
+                for (const auto& entry : slice.entries) {
+                    if (entry.isExpired(now)) continue;
+                    auto expiration = entry.getExpiration();
+                    writer.add(entry.getKey(), entry.getValue(), expiration ? toWallClockMs(*expiration, offset) : 0,
+                               entry.isCompressed());
+                }
             } else {
-                out << -1;
+                auto now = CoarseClock::now();
+                for (const auto& key : dirty) {
+                    auto it = slice.entries.find(std::string_view(key));
+                    if (it == slice.entries.end() || it->isExpired(now)) {
+                        writer.add(key, {}, SNAPSHOT_REMOVED);
+                    } else {
+                        auto expiration = it->getExpiration();
+                        writer.add(key, it->getValue(), expiration ? toWallClockMs(*expiration, offset) : 0,
+                                   it->isCompressed());
+                    }
+                }
             }
-            out << '\n';
         }
+        dirty.clear();
+        writer.flush();
+    }
+    uint64_t endLSN = wal ? wal->getLastLSN() : 0;
+    writer.finish(startLSN);
+
+    // The image may reflect any record up to endLSN, so those have to be
+    // durable before it replaces the old snapshot: otherwise a crash could
+    // leave the image ahead of a log that lost them, and LSNs handed out
+    // after restart would collide with ones the snapshot already covers
+    if (wal) {
+        wal->waitFor(endLSN, Durability::Sync);
+    }
+    syncPath(tmpFilename);
+    // Unpublished, the snapshot covers nothing: the segments stay, and so
+    // does the temp file for a look at what went wrong
+    if (std::rename(tmpFilename.c_str(), target.c_str()) != 0) {
+        throw std::runtime_error("Failed to rename snapshot " + tmpFilename + " to " + target + ": " +
+                                 std::strerror(errno));
+    }
+    syncParentDirectory(target);
+
+    if (full) {
+        // The new base supersedes every delta. Any left behind by a crash
+        // here have LSNs at or below it and are skipped at load.
+        for (uint64_t lsn : findNumberedFiles(filename, DELTA_TAG, LSN_DIGITS)) {
+            if (lsn <= startLSN) std::filesystem::remove(deltaSnapshotPath(filename, lsn));
+        }
+        deltaChainLength = 0;
+    } else {
+        ++deltaChainLength;
     }
-    out.close();
-    std::rename(tmpFilename.c_str(), filename.c_str());
+    fullSnapshotPending = false;
 
+    // Only now is it safe to drop the segments the snapshot covers. Records
+    // written while we were scanning stay in the log.
     if (wal) {
-        wal->reset();  // Truncate WAL after a snapshot
+        wal->retireSegments(startLSN);
     }
 }
 
-void KVStore::loadSnapshot(const std::string& filename) {
+// Loads the newest full snapshot, then the deltas taken after it in LSN
+// order. Returns the LSN the whole chain covers.
+uint64_t KVStore::loadSnapshot(const std::string& filename) {
+    // Clocks are read once for the whole load; keys expiring meanwhile are
+    // left to cleanup
+    auto offset = wallClockOffset();
+    auto now = std::chrono::steady_clock::now();
+    auto apply = [this, offset, now](std::string_view view, std::string_view value, uint64_t expiryMs,
+                                     bool compressed) {
+        HashedKey key(view);
+        Slice& slice = sliceFor(key);
+        std::optional<std::chrono::steady_clock::time_point> expiration;
+        if (expiryMs > 0 && expiryMs != SNAPSHOT_REMOVED) {
+            expiration = fromWallClockMs(expiryMs, offset, now);
+            if (!expiration) expiryMs = SNAPSHOT_REMOVED; // Expired while we were down
+        }
+        if (expiryMs == SNAPSHOT_REMOVED) {
+            eraseKey(slice, key);
+            return;
+        }
+        if (compressed) checkCompressedValue(view, value);
+        Entry entry(view, value, expiration, slabs.get(), initialAccess(), compressed);
+        if (expiration) scheduleExpiry(view, *entry.getExpiration());
+        upsert(slice, std::move(entry), key.hash);
+    };
+
+    uint64_t lsn = 0;
+    auto base = SnapshotReader::open(filename);
+    if (base && base->isBinary()) {
+        reserve(base->getEntryCount());
+        base->forEach(apply);
+        lsn = base->getLSN();
+    } else if (base) {
+        lsn = loadTextSnapshot(filename);
+    }
+    base.reset();
+
+    for (uint64_t deltaLSN : findNumberedFiles(filename, DELTA_TAG, LSN_DIGITS)) {
+        if (deltaLSN <= lsn) continue; // Superseded by the base
+        auto delta = SnapshotReader::open(deltaSnapshotPath(filename, deltaLSN));
+        if (!delta || !delta->isBinary() || delta->getKind() != SnapshotKind::Delta) {
+            throw std::runtime_error("Invalid delta snapshot: " + deltaSnapshotPath(filename, deltaLSN));
+        }
+        delta->forEach(apply);
+        lsn = delta->getLSN();
+        ++deltaChainLength;
+    }
+    recoveryStats.deltaSnapshots = deltaChainLength;
+    fullSnapshotPending = !std::filesystem::exists(filename);
+    return lsn;
+}
+
+// Tab-separated snapshots from before the binary format, so an upgraded
+// node can still start from the snapshot its old version left behind
+uint64_t KVStore::loadTextSnapshot(const std::string& filename) {
     std::ifstream infile(filename);
     if (!infile.is_open()) {
-        // Snapshot file does not exist, starting with empty store - removed logging for performance
-        return; // Gracefully handle missing snapshot file
+        throw std::runtime_error("Failed to open snapshot file: " + filename);
     }
 
+    // The first line names the last WAL LSN the snapshot covers and how
+    // many entries follow
+    uint64_t lsn = 0;
     std::string line;
+    if (std::getline(infile, line) && line.rfind(TEXT_SNAPSHOT_MAGIC, 0) == 0) {
+        std::istringstream header(line.substr(std::strlen(TEXT_SNAPSHOT_MAGIC)));
+        size_t entries = 0;
+        header >> lsn >> entries;
+        reserve(entries);
+    } else {
+        infile.clear();
+        infile.seekg(0);
+    }
+
     while (std::getline(infile, line)) {
         std::istringstream iss(line);
         std::string key, value;
@@ -181,40 +607,356 @@ void KVStore::loadSnapshot(const std::string& filename) {
         if (!(iss >> key >> value >> expiry_epoch)) continue;
 
         if (expiry_epoch != -1) {
+            // These were steady_clock deadlines, only meaningful within the
+            // boot that wrote them
             auto expiration = std::chrono::steady_clock::time_point{
                 std::chrono::milliseconds(expiry_epoch)
             };
-            std::unique_lock lock(mutex);
-            store[key] = Value(value, expiration);
+            if (expiration <= std::chrono::steady_clock::now()) continue;
+            Entry entry(key, value, expiration, slabs.get(), initialAccess());
+            scheduleExpiry(key, *entry.getExpiration());
+            upsert(sliceFor(key), std::move(entry));
         } else {
-            std::unique_lock lock(mutex);
-            store[key] = Value(value);
+            upsert(sliceFor(key), Entry(key, value, std::nullopt, slabs.get(), initialAccess()));
         }
     }
+    return lsn;
+}
+
+// Called with the key's slice lock held, or during recovery. A key already
+// in the wheel moves to its new deadline.
+void KVStore::scheduleExpiry(std::string_view key, std::chrono::steady_clock::time_point deadline) {
+    if (options.expiryMode == ExpiryMode::TimingWheel) {
+        std::lock_guard<std::mutex> lock(expiryMutex);
+        expirations.schedule(key, deadline);
+        expiryIndexBytes.store(expirations.memoryBytes(), std::memory_order_relaxed);
+    }
+}
+
+// For a key with a TTL that is removed, or overwritten without one; same
+// locking as scheduleExpiry()
+void KVStore::cancelExpiry(std::string_view key) {
+    if (options.expiryMode == ExpiryMode::TimingWheel) {
+        std::lock_guard<std::mutex> lock(expiryMutex);
+        expirations.cancel(key);
+        expiryIndexBytes.store(expirations.memoryBytes(), std::memory_order_relaxed);
+    }
 }
 
 void KVStore::cleanup_expired_keys() {
-    std::unique_lock lock(mutex);
-    for (auto it = store.begin(); it != store.end(); ) {
-        if (it->second.isExpired()) {
-            it = store.erase(it);
-        } else {
-            ++it;
+    std::lock_guard<std::mutex> cleanup(cleanupMutex);
+    auto cpuStart = threadCpuTime();
+    if (options.expiryMode == ExpiryMode::Sampled) {
+        expireSampled();
+    } else {
+        expireDue();
+    }
+    compact();
+    auto cpu = threadCpuTime() - cpuStart;
+    std::lock_guard<std::mutex> lock(expiryMutex);
+    ++expiryStats.cycles;
+    expiryStats.cpuTime += cpu;
+}
+
+// Removes keys whose TTL ran out, looking only at the ones the timing wheel
+// reports due, a batch at a time and each under its own slice's lock
+void KVStore::expireDue() {
+    std::vector<TimingWheel::Entry> due;
+    do {
+        due.clear();
+        {
+            std::lock_guard<std::mutex> lock(expiryMutex);
+            expirations.collectDue(CoarseClock::now(), due, EXPIRY_BATCH);
+            expiryIndexBytes.store(expirations.memoryBytes(), std::memory_order_relaxed);
+        }
+        uint64_t expired = 0;
+        for (const auto& entry : due) {
+            HashedKey key(entry.key);
+            Slice& slice = sliceFor(key);
+            std::unique_lock lock(slice.mutex);
+            auto it = findKey(slice, key);
+            // A key rescheduled since it was collected keeps its new entry
+            if (it != slice.entries.end() && it->getExpiration() == entry.deadline) {
+                slice.entries.erase(it);
+                ++expired;
+            }
+        }
+        std::lock_guard<std::mutex> lock(expiryMutex);
+        expiryStats.keysExpired += expired;
+    } while (due.size() == EXPIRY_BATCH);
+}
+
+// Adaptive sampling: each round probes up to expirySampleSize TTL keys in
+// random buckets and removes the expired ones. Another round follows while
+// more than expiryRepeatThreshold of the probed keys were expired, within
+// the cycle's time budget. Each probe holds only its slice's lock.
+void KVStore::expireSampled() {
+    auto budgetEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.expiryCycleBudgetMs);
+    size_t sampleSize = std::max<size_t>(options.expirySampleSize, 1);
+    std::vector<std::string> expired;
+    bool firstRound = true;
+    while (true) {
+        size_t probed = 0, expiredCount = 0;
+        size_t visited = 0, expiredBytes = 0; // visited counts keys without a TTL too
+        auto now = CoarseClock::now();
+        // Keys without a TTL are passed over, so the buckets visited are
+        // bounded rather than looping until enough TTL keys turn up
+        for (size_t attempt = 0; attempt < sampleSize * 4 && probed < sampleSize; ++attempt) {
+            Slice& slice = slices[expiryRandom() % SLICE_COUNT];
+            std::unique_lock lock(slice.mutex);
+            if (slice.entries.empty()) continue;
+            size_t bucket = expiryRandom() % slice.entries.bucket_count();
+            expired.clear();
+            for (auto it = slice.entries.begin(bucket); it != slice.entries.end(bucket); ++it) {
+                ++visited;
+                if (!it->hasExpiration()) continue;
+                size_t bytes = it->getKey().size() + it->getValue().size();
+                ++probed;
+                if (it->isExpired(now)) {
+                    expired.push_back(std::string(it->getKey()));
+                    expiredBytes += bytes;
+                }
+            }
+            for (const auto& key : expired) {
+                eraseKey(slice, key);
+            }
+            expiredCount += expired.size();
+        }
+
+        size_t entries = firstRound && visited > 0 ? entryCount() : 0;
+        {
+            std::lock_guard<std::mutex> lock(expiryMutex);
+            expiryStats.keysProbed += probed;
+            expiryStats.keysExpired += expiredCount;
+            if (firstRound && visited > 0) {
+                // The first round sees what earlier cycles left behind. Its
+                // few probes are noisy, so the estimate follows a moving average.
+                double fraction = static_cast<double>(expiredCount) / visited;
+                expiredFraction = expiryStats.cycles == 0 ? fraction : expiredFraction + (fraction - expiredFraction) / 8;
+                if (expiredCount > 0) expiredEntryBytes = static_cast<double>(expiredBytes) / expiredCount;
+                expiryStats.expiredKeysEstimate = static_cast<uint64_t>(expiredFraction * entries);
+                expiryStats.expiredBytesEstimate = static_cast<uint64_t>(expiryStats.expiredKeysEstimate * expiredEntryBytes);
+            }
+        }
+        firstRound = false;
+
+        if (probed == 0 || expiredCount <= options.expiryRepeatThreshold * probed ||
+            std::chrono::steady_clock::now() >= budgetEnd) {
+            return;
+        }
+    }
+}
+
+// Moves entries out of the slabs the allocator can do without, a slice at
+// a time, once enough slab memory is free. The old blocks are retired like
+// any replaced entry's, and their slabs unmapped when the last is freed.
+// Called with cleanupMutex held.
+void KVStore::compact() {
+    if (slabs->getFragmentation() <= options.compactFragmentation) return;
+    if (slabs->beginCompaction() == 0) return;
+    uint64_t moved = 0;
+    for (auto& slice : slices) {
+        std::unique_lock lock(slice.mutex);
+        for (auto it = slice.entries.begin(); it != slice.entries.end(); ++it) {
+            if (!it->isEvacuating()) continue;
+            replaceEntry(slice, it, Entry::copy(*it, slabs.get()));
+            ++moved;
+        }
+    }
+    EpochReclaimer::reclaim();
+    compactions.fetch_add(1, std::memory_order_relaxed);
+    entriesMoved.fetch_add(moved, std::memory_order_relaxed);
+}
+
+//
+// Compression
+//
+
+// The value compressed for storage, or nullopt if the store doesn't
+// compress values this small or compressing this one saved too little
+std::optional<std::string> KVStore::compressValue(std::string_view value) {
+    if (options.valueCompression == ValueCompression::None || value.size() < options.compressionMinBytes) {
+        return std::nullopt;
+    }
+    auto compressed = ValueCodec::compress(options.valueCompression, value);
+    if (!compressed) {
+        valuesIncompressible.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    valuesCompressed.fetch_add(1, std::memory_order_relaxed);
+    compressedRawBytes.fetch_add(value.size(), std::memory_order_relaxed);
+    compressedStoredBytes.fetch_add(compressed->size(), std::memory_order_relaxed);
+    return compressed;
+}
+
+CompressionStats KVStore::getCompressionStats() const {
+    CompressionStats stats;
+    stats.valuesCompressed = valuesCompressed.load(std::memory_order_relaxed);
+    stats.valuesIncompressible = valuesIncompressible.load(std::memory_order_relaxed);
+    stats.rawBytes = compressedRawBytes.load(std::memory_order_relaxed);
+    stats.storedBytes = compressedStoredBytes.load(std::memory_order_relaxed);
+    if (stats.storedBytes > 0) stats.ratio = static_cast<double>(stats.rawBytes) / stats.storedBytes;
+    return stats;
+}
+
+//
+// Eviction
+//
+
+// What a new entry's access word starts as, or none if entries don't have one
+std::optional<uint32_t> KVStore::initialAccess() const {
+    if (!trackAccess) return std::nullopt;
+    auto now = CoarseClock::now();
+    if (options.evictionPolicy == EvictionPolicy::LFU) return accessClockMinutes(now) << 8 | LFU_INITIAL;
+    return accessClockMs(now);
+}
+
+// Records a use of the entry. Lock-free readers call it too, so it touches
+// nothing but the access word, and writes that as rarely as the policy
+// allows: LRU once per LRU_TOUCH_INTERVAL_MS, LFU when its minute rolls
+// over or a hit wins the draw, which gets rarer as the counter grows.
+void KVStore::touch(const EntryView& entry) const {
+    if (!entry.isTracked()) return;
+    auto now = CoarseClock::now();
+    uint32_t access = entry.getAccess();
+    uint32_t updated;
+    if (options.evictionPolicy == EvictionPolicy::LFU) {
+        uint32_t minutes = accessClockMinutes(now);
+        uint32_t counter = lfuCounter(access, minutes, options.lfuDecayMinutes);
+        // The higher the counter, the less likely a hit moves it
+        if (counter < UINT8_MAX) {
+            double base = counter > LFU_INITIAL ? counter - LFU_INITIAL : 0;
+            auto& random = threadRandom();
+            double draw = static_cast<double>(random() - random.min()) / (random.max() - random.min());
+            if (draw < 1.0 / (base * options.lfuLogFactor + 1)) ++counter;
+        }
+        updated = minutes << 8 | counter;
+    } else {
+        updated = accessClockMs(now);
+        if (updated - access < LRU_TOUCH_INTERVAL_MS) return;
+    }
+    if (updated != access) entry.setAccess(updated);
+}
+
+// Higher goes first
+uint64_t KVStore::evictionScore(const EntryView& entry, std::chrono::steady_clock::time_point now) const {
+    switch (options.evictionPolicy) {
+        case EvictionPolicy::LRU:
+            return entry.isTracked() ? static_cast<uint32_t>(accessClockMs(now) - entry.getAccess()) : 0;
+        case EvictionPolicy::LFU:
+            return entry.isTracked()
+                ? UINT8_MAX - lfuCounter(entry.getAccess(), accessClockMinutes(now), options.lfuDecayMinutes)
+                : 0;
+        case EvictionPolicy::VolatileTTL:
+            return UINT64_MAX - static_cast<uint64_t>((*entry.getExpiration() - EntryView::EPOCH).count());
+    }
+    return 0;
+}
+
+// The best of evictionSamples random keys the policy lets us evict, or
+// none if a bounded number of buckets turned up none
+std::optional<std::string> KVStore::sampleEvictionCandidate() {
+    auto& random = threadRandom();
+    auto now = CoarseClock::now();
+    size_t samples = std::max<size_t>(options.evictionSamples, 1);
+    std::optional<std::string> best;
+    uint64_t bestScore = 0;
+    size_t sampled = 0;
+    for (size_t attempt = 0; attempt < samples * 8 && sampled < samples; ++attempt) {
+        Slice& slice = slices[random() % SLICE_COUNT];
+        std::shared_lock lock(slice.mutex);
+        if (slice.entries.empty()) continue;
+        size_t bucket = random() % slice.entries.bucket_count();
+        for (auto it = slice.entries.begin(bucket); it != slice.entries.end(bucket); ++it) {
+            if (options.evictionPolicy == EvictionPolicy::VolatileTTL && !it->hasExpiration()) continue;
+            ++sampled;
+            uint64_t score = evictionScore(*it, now);
+            if (!best || score > bestScore) {
+                best.emplace(it->getKey());
+                bestScore = score;
+            }
+        }
+    }
+    return best;
+}
+
+// Removes keys until the store is back under its memory limit. A put that
+// finds an eviction already under way leaves it to that one rather than
+// waiting.
+void KVStore::evict() {
+    std::unique_lock evicting(evictionMutex, std::try_to_lock);
+    if (!evicting) return;
+    while (memoryUsed() > options.maxMemoryBytes) {
+        auto candidate = sampleEvictionCandidate();
+        if (!candidate) {
+            evictionMisses.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // Logged like a remove, so a restart doesn't bring the key back
+        HashedKey key(*candidate);
+        EncodedRecord record = wal ? WriteAheadLog::encodeRecord(WALOp::Remove, key.view) : std::string();
+        Slice& slice = sliceFor(key);
+        size_t freed = 0;
+        applyLogged(slice, std::move(record), Durability::None, [&] {
+            auto it = findKey(slice, key);
+            if (it == slice.entries.end()) return; // Removed since it was sampled
+            freed = it->blockSize() + it->externalSize();
+            if (it->hasExpiration()) cancelExpiry(key.view);
+            slice.entries.erase(it);
+            trackChange(slice, key.view);
+        });
+        if (freed > 0) {
+            keysEvicted.fetch_add(1, std::memory_order_relaxed);
+            bytesEvicted.fetch_add(freed, std::memory_order_relaxed);
         }
     }
 }
 
+// What maxMemoryBytes limits
+size_t KVStore::memoryUsed() const {
+    return slabs->getBytesUsed() + expiryIndexBytes.load(std::memory_order_relaxed);
+}
+
+MemoryStats KVStore::getMemoryStats() const {
+    MemoryStats stats;
+    stats.bytesUsed = slabs->getBytesUsed();
+    stats.expiryIndexBytes = expiryIndexBytes.load(std::memory_order_relaxed);
+    stats.bytesRetired = slabs->getBytesRetired();
+    stats.slabBytes = slabs->getSlabBytes();
+    stats.fragmentation = slabs->getFragmentation();
+    stats.compactions = compactions.load(std::memory_order_relaxed);
+    stats.entriesMoved = entriesMoved.load(std::memory_order_relaxed);
+    stats.keysEvicted = keysEvicted.load(std::memory_order_relaxed);
+    stats.bytesEvicted = bytesEvicted.load(std::memory_order_relaxed);
+    stats.evictionMisses = evictionMisses.load(std::memory_order_relaxed);
+    return stats;
+}
+
+ExpiryStats KVStore::getExpiryStats() {
+    std::lock_guard<std::mutex> lock(expiryMutex);
+    return expiryStats;
+}
+
+void KVStore::runCleanup() {
+    cleanup_expired_keys();
+}
+
+void KVStore::runSnapshot() {
+    snapshot(snapshotFileName);
+}
+
 void KVStore::shutdown() {
     if (wal) {
         wal->flush();
     }
     // Optionally, save a snapshot before shutdown
     if (!snapshotFileName.empty()) {
-        std::shared_lock lock(mutex);
         snapshot(snapshotFileName);
     }
     {
-        std::unique_lock lock(mutex);
+        // Under both wait mutexes, so neither thread can miss the flag
+        // between checking it and waiting
+        std::scoped_lock lock(cleanerMutex, snapshotMutex);
         stopFlag.store(true);
     }
     snapshotCV.notify_all(); // Notify background threads to stop
@@ -231,4 +973,7 @@ void KVStore::shutdown() {
 
 KVStore::~KVStore() {
     shutdown();
+    // Frees the blocks this store retired, where no reader holds them, so
+    // its slabs can go with it
+    EpochReclaimer::reclaim();
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <array>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <unordered_set>
 #include <shared_mutex>
 #include <optional>
 #include <memory>
@@ -9,48 +11,272 @@
 #include <atomic>
 #include <thread>
 #include <condition_variable>
+#include <random>
 
-class WriteAheadLog;
+#include "durability.hpp"
+#include "entry.hpp"
+#ifdef KV_SWISS_TABLE
+#include "entry_table.hpp"
+#endif
+#include "timing_wheel.hpp"
+#include "value_codec.hpp"
+#include "wal.hpp"
+
+// How cleanup finds keys whose TTL ran out. Either way get() never returns
+// an expired value.
+enum class ExpiryMode {
+    // Every deadline is indexed in a timing wheel and removed when due
+    TimingWheel,
+    // Nothing is indexed; cleanup probes random keys and keeps going while
+    // enough of them turn out expired. Saves the index when nearly every
+    // key has a TTL, at the cost of expired keys lingering for a while.
+    Sampled,
+};
+
+// What a store over its memory limit evicts first. Eviction samples a few
+// random keys and removes the best candidate among them, so the order is
+// approximate.
+enum class EvictionPolicy {
+    // Least recently read or written
+    LRU,
+    // Least frequently used, by a logarithmic hit counter that decays
+    // while the key goes unused
+    LFU,
+    // Keys with a TTL, soonest deadline first; keys without one are never
+    // evicted
+    VolatileTTL,
+};
+
+struct KVStoreOptions {
+    // Default durability for put/remove calls that don't pass their own
+    Durability durability = Durability::None;
+
+    size_t snapshotIntervalSeconds = 30; // Reduced frequency to avoid flooding
+    size_t cleanupIntervalMs = 1000;
+
+    // WAL settings; set wal.writerPool to drain the log on a shared pool
+    // instead of a dedicated thread
+    WALOptions wal;
+
+    // Snapshots after a full one only write the keys changed since the
+    // previous snapshot; after this many deltas the next one is full again.
+    // 0 writes only full snapshots.
+    size_t deltaSnapshotsPerFull = 8;
+
+    ExpiryMode expiryMode = ExpiryMode::TimingWheel;
+    // Sampled mode: TTL keys probed per round, the expired fraction above
+    // which another round follows, and the cap on one cleanup's duration
+    size_t expirySampleSize = 20;
+    double expiryRepeatThreshold = 0.25;
+    size_t expiryCycleBudgetMs = 25;
+
+    // Cleanup compacts the entry slabs once more than this share of their
+    // memory is free, moving entries out of the emptiest slabs so those
+    // can be unmapped. 1 never compacts.
+    double compactFragmentation = 0.25;
+
+    // Bytes the entries and their TTL index may take (MemoryStats::bytesUsed
+    // plus expiryIndexBytes) before puts start evicting keys; 0 for no
+    // limit. A PartitionedKVStore splits it evenly over its partitions.
+    size_t maxMemoryBytes = 0;
+    EvictionPolicy evictionPolicy = EvictionPolicy::LRU;
+    size_t evictionSamples = 5; // Keys compared per eviction
+    // LFU: how much slower each hit makes the counter climb, and the
+    // minutes it takes to drop by one while the key is unused
+    double lfuLogFactor = 10;
+    size_t lfuDecayMinutes = 1;
+
+    // Values of at least compressionMinBytes are compressed with this codec
+    // when that saves an eighth or more, and stay compressed in memory, the
+    // WAL and snapshots; get() decompresses them. Opening a store with a
+    // codec this build lacks (see ValueCodec) throws.
+    ValueCompression valueCompression = ValueCompression::None;
+    size_t compressionMinBytes = 1024;
+    // Codec snapshot blocks are written with, each kept compressed only if
+    // that makes it smaller. Snapshots are read whatever codec wrote them,
+    // as long as it is built in; opening a store with one that isn't throws.
+    ValueCompression snapshotCompression = ValueCompression::None;
+
+    // When false no cleaner/snapshot threads are started and the owner calls
+    // runCleanup()/runSnapshot() from its own scheduler
+    bool backgroundThreads = true;
+};
+
+// Where a store's startup time went
+struct RecoveryStats {
+    std::chrono::microseconds snapshotLoad{0};
+    std::chrono::microseconds walReplay{0};
+    size_t snapshotEntries = 0;
+    size_t deltaSnapshots = 0;
+    size_t walRecords = 0;
+};
+
+// Cumulative TTL cleanup counters, for tuning the expiry mode
+struct ExpiryStats {
+    uint64_t cycles = 0;
+    uint64_t keysProbed = 0; // Sampled mode only
+    uint64_t keysExpired = 0;
+    std::chrono::microseconds cpuTime{0}; // Thread CPU spent in cleanup
+    // Sampled mode, estimated from recent cycles' first rounds: expired
+    // keys still held in memory and the bytes their keys and values take
+    uint64_t expiredKeysEstimate = 0;
+    uint64_t expiredBytesEstimate = 0;
+};
+
+// Memory the store's entries take, and how well it is packed
+struct MemoryStats {
+    size_t bytesUsed = 0;    // Exactly: live entry blocks and the shared values they hold
+    size_t expiryIndexBytes = 0; // The timing wheel's entries for keys with a TTL
+    size_t bytesRetired = 0; // Replaced and removed ones not yet reclaimed
+    size_t slabBytes = 0;    // Mapped for slabs
+    double fragmentation = 0; // Share of slab memory not holding entries
+    uint64_t compactions = 0;
+    uint64_t entriesMoved = 0;
+    uint64_t keysEvicted = 0;
+    uint64_t bytesEvicted = 0;
+    // Times the store was over its limit and sampling found nothing the
+    // policy lets it evict
+    uint64_t evictionMisses = 0;
+};
+
+// Cumulative value compression counters, over the puts this store has
+// compressed since it was opened
+struct CompressionStats {
+    uint64_t valuesCompressed = 0;
+    // Values big enough to compress that were stored as they were, as
+    // compressing them saved too little
+    uint64_t valuesIncompressible = 0;
+    uint64_t rawBytes = 0;    // Of the values compressed
+    uint64_t storedBytes = 0; // What they were compressed to, frames included
+    double ratio = 1;         // rawBytes / storedBytes
+};
 
 class KVStore {
 private:
-    struct Value {
-        std::string value;
-        std::optional<std::chrono::steady_clock::time_point> expiration;
-        Value();
-        Value(const std::string& val);
-        Value(const std::string& val, std::chrono::steady_clock::time_point exp);
-        bool isExpired() const;
-    };
-
     std::thread cleaner;
     std::thread snapshotThread;
     std::atomic<bool> stopFlag = false;
 
-    std::unordered_map<std::string, Value> store;
-    std::shared_mutex mutex; // Read-write lock for concurrent reads
+    // The map is split by key hash into fixed slices, each with its own
+    // lock, so writers to different slices don't wait on each other and
+    // snapshots and cleanup walk the map a slice at a time
+    static constexpr size_t SLICE_COUNT = 64;
+    // Searchable by a key view without copying it
+    using KeySet = std::unordered_set<std::string, EntryHash, std::equal_to<>>;
+    // Entry blocks are carved from these; outlives the slices, which free
+    // their blocks into it
+    SlabAllocator::Handle slabs = SlabAllocator::create();
+    struct alignas(64) Slice {
+        std::shared_mutex mutex; // Guards the fields below
+#ifdef KV_SWISS_TABLE
+        EntryTable entries;
+#else
+        std::unordered_set<Entry, EntryHash, EntryKeyEqual> entries;
+#endif
+        // Keys changed since the last snapshot, when deltas are enabled
+        KeySet dirty;
+    };
+    std::array<Slice, SLICE_COUNT> slices;
+    using SliceIterator = decltype(Slice::entries)::const_iterator;
+    // Values at least this big are stored out of line, in a buffer shared
+    // with their WAL record rather than copied into both
+    static constexpr size_t SHARED_VALUE_MIN = 4096;
+    // Lock-free tries a get makes before taking the slice's shared lock
+    static constexpr int OPTIMISTIC_READ_ATTEMPTS = 4;
+    bool trackChanges = false;
+    // Deadlines of keys with a TTL, so cleanup only visits keys that are
+    // due. Taken after a slice lock, never before one.
+    std::mutex expiryMutex; // Guards expirations and expiryStats
+    TimingWheel expirations;
+    ExpiryStats expiryStats;
+    std::atomic<size_t> expiryIndexBytes{0}; // expirations.memoryBytes(), readable without the lock
+    static constexpr size_t EXPIRY_BATCH = 1024; // Keys expired per wheel visit
+    // One cleanup at a time; guards the sampled mode state below
+    std::mutex cleanupMutex;
+    std::minstd_rand expiryRandom;
+    double expiredFraction = 0; // Overhang averages
+    double expiredEntryBytes = 0;
+    std::atomic<uint64_t> compactions{0};
+    std::atomic<uint64_t> entriesMoved{0};
+    // With a memory limit, entries carry an access word for LRU and LFU
+    bool trackAccess = false;
+    std::mutex evictionMutex; // One eviction at a time
+    std::atomic<uint64_t> keysEvicted{0};
+    std::atomic<uint64_t> bytesEvicted{0};
+    std::atomic<uint64_t> evictionMisses{0};
+    std::atomic<uint64_t> valuesCompressed{0};
+    std::atomic<uint64_t> valuesIncompressible{0};
+    std::atomic<uint64_t> compressedRawBytes{0};
+    std::atomic<uint64_t> compressedStoredBytes{0};
     mutable std::mutex snapshotMutex;
     mutable std::mutex cleanerMutex;
     std::condition_variable snapshotCV;
     std::condition_variable cleanerCV;
     std::unique_ptr<WriteAheadLog> wal;
     std::string snapshotFileName;
+    KVStoreOptions options;
+    RecoveryStats recoveryStats;
 
-    size_t snapshotIntervalSeconds = 30; // Reduced frequency to avoid flooding
+    // Snapshot chain state, guarded by checkpointMutex
+    std::mutex checkpointMutex;
+    size_t deltaChainLength = 0;
+    bool fullSnapshotPending = true;
 
-    void recoverFromWAL(const std::string& filename);
+    Slice& sliceFor(const HashedKey& key);
+    static auto findKey(const Slice& slice, const HashedKey& key);
+    void upsert(Slice& slice, Entry&& entry, size_t hash);
+    void upsert(Slice& slice, Entry&& entry) { upsert(slice, std::move(entry), EntryHash{}(entry)); }
+    static void replaceEntry(Slice& slice, SliceIterator it, Entry&& entry);
+    void eraseKey(Slice& slice, const HashedKey& key);
+    void trackChange(Slice& slice, std::string_view key);
+    size_t entryCount();
+    void reserve(size_t entries);
+    std::optional<std::string> compressValue(std::string_view value);
+    WALReplayResult recoverFromWAL(const std::string& filename, uint64_t afterLSN);
     void snapshot(const std::string& filename);
-    void loadSnapshot(const std::string& filename);
-    void cleanup_expired_keys();    
+    uint64_t loadSnapshot(const std::string& filename);
+    uint64_t loadTextSnapshot(const std::string& filename);
+    void scheduleExpiry(std::string_view key, std::chrono::steady_clock::time_point deadline);
+    void cancelExpiry(std::string_view key);
+    size_t memoryUsed() const;
+    void cleanup_expired_keys();
+    void expireDue();
+    void expireSampled();
+    void compact();
+    std::optional<uint32_t> initialAccess() const;
+    void touch(const EntryView& entry) const;
+    uint64_t evictionScore(const EntryView& entry, std::chrono::steady_clock::time_point now) const;
+    std::optional<std::string> sampleEvictionCandidate();
+    void evict();
+    template <typename Mutation>
+    void applyLogged(Slice& slice, EncodedRecord record, Durability durability, Mutation&& mutate);
+    void putEntry(const HashedKey& key, PutValue value,
+                  std::optional<std::chrono::steady_clock::time_point> expiration, Durability durability);
     void startBackgroundThreads();
-    KVStore(const std::string& logFile);
+    KVStore(const std::string& logFile, const KVStoreOptions& options);
 public:
     KVStore();
     ~KVStore();
     static std::unique_ptr<KVStore> create(const std::string& logFile);
-    void put(const std::string& key, const std::string& value);
-    void put(const std::string& key, const std::string& value, int ttl_ms);
-    std::optional<std::string> get(const std::string& key);
-    void remove(const std::string& key);
+    static std::unique_ptr<KVStore> create(const std::string& logFile, const KVStoreOptions& options);
+    // Keys are taken by view, hashed once; callers that already hashed the
+    // key pass a HashedKey. Values are copied unless passed as an rvalue
+    // std::string, which a large value is kept in as is.
+    void put(const HashedKey& key, PutValue value);
+    void put(const HashedKey& key, PutValue value, Durability durability);
+    void put(const HashedKey& key, PutValue value, int ttl_ms);
+    void put(const HashedKey& key, PutValue value, int ttl_ms, Durability durability);
+    std::optional<std::string> get(const HashedKey& key);
+    void remove(const HashedKey& key);
+    void remove(const HashedKey& key, Durability durability);
+
+    // One round of background maintenance, for owners that schedule it
+    // themselves (see KVStoreOptions::backgroundThreads)
+    void runCleanup();
+    void runSnapshot();
+    const RecoveryStats& getRecoveryStats() const { return recoveryStats; }
+    ExpiryStats getExpiryStats();
+    MemoryStats getMemoryStats() const;
+    CompressionStats getCompressionStats() const;
     void shutdown();
 };
@@ -0,0 +1,64 @@
+#include "maintenance_scheduler.hpp"
+
+#include <iostream>
+
+MaintenanceScheduler::MaintenanceScheduler() {
+    worker = std::thread(&MaintenanceScheduler::run, this);
+}
+
+MaintenanceScheduler::~MaintenanceScheduler() {
+    stop();
+}
+
+void MaintenanceScheduler::schedule(std::chrono::milliseconds interval,
+                                    std::chrono::milliseconds initialDelay,
+                                    std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back({interval, std::move(task)});
+        queue.push({Clock::now() + initialDelay, tasks.size() - 1});
+    }
+    condition.notify_one();
+}
+
+void MaintenanceScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopFlag = true;
+    }
+    condition.notify_one();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void MaintenanceScheduler::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopFlag) {
+        if (queue.empty()) {
+            condition.wait(lock, [this] { return stopFlag || !queue.empty(); });
+            continue;
+        }
+        auto next = queue.top();
+        if (condition.wait_until(lock, next.when, [&] {
+                return stopFlag || queue.top().when < next.when;
+            })) {
+            continue; // Stopped, or an earlier task was scheduled
+        }
+
+        queue.pop();
+        Task& task = tasks[next.task];
+        lock.unlock();
+        try {
+            task.run();
+        } catch (const std::exception& e) {
+            std::cerr << "[Scheduler] Background task failed: " << e.what() << "\n";
+        }
+        lock.lock();
+
+        // Keep the cadence, but don't try to catch up on missed runs
+        auto due = next.when + task.interval;
+        auto now = Clock::now();
+        queue.push({due > now ? due : now + task.interval, next.task});
+    }
+}
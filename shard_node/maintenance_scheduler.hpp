@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Runs periodic background work (TTL cleanup, snapshots) for many stores on
+// a single thread, sleeping until the next task is due instead of keeping a
+// timer thread per store. Tasks run one at a time, so a long task delays the
+// ones behind it rather than running concurrently with them.
+class MaintenanceScheduler {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Task {
+            std::chrono::milliseconds interval;
+            std::function<void()> run;
+        };
+        struct Due {
+            Clock::time_point when;
+            size_t task;
+            bool operator>(const Due& other) const { return when > other.when; }
+        };
+
+        std::deque<Task> tasks; // Only grows; references stay valid while unlocked
+        std::priority_queue<Due, std::vector<Due>, std::greater<Due>> queue;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopFlag = false;
+        std::thread worker;
+
+        void run();
+
+    public:
+        MaintenanceScheduler();
+        ~MaintenanceScheduler();
+
+        // Runs `task` every `interval`, first after `initialDelay`.
+        void schedule(std::chrono::milliseconds interval, std::chrono::milliseconds initialDelay,
+                      std::function<void()> task);
+
+        // Stops the scheduler thread; a task in progress finishes first.
+        void stop();
+};
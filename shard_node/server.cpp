@@ -21,6 +21,13 @@ int main() {
     auto store = std::make_unique<PartitionedKVStore>(264);
     
     std::cout << "Starting gRPC KVStore server with " << store->getPartitionCount() << " partitions...\n";
+
+    auto recovery = store->getRecoveryStats();
+    std::cout << "Recovered in " << store->getRecoveryTime().count() / 1000.0 << " ms: "
+              << recovery.snapshotEntries << " entries from snapshots ("
+              << recovery.snapshotLoad.count() / 1000.0 << " ms), "
+              << recovery.walRecords << " WAL records replayed ("
+              << recovery.walReplay.count() / 1000.0 << " ms) across partitions\n";
     
     // Start the gRPC server
     Serve(store.get());
@@ -4,6 +4,7 @@ KVStoreServiceImpl::KVStoreServiceImpl(PartitionedKVStore* store) : store_(store
 
 grpc::Status KVStoreServiceImpl::Put(grpc::ServerContext*, const kvstore::PutRequest* req, kvstore::PutResponse* resp) {
     try {
+        // gRPC owns the request, so the store copies the value it borrows
         if (req->ttl_ms() > 0)
             store_->put(req->key(), req->value(), static_cast<int>(req->ttl_ms()));
         else
@@ -22,7 +23,7 @@ grpc::Status KVStoreServiceImpl::Get(grpc::ServerContext*, const kvstore::GetReq
         auto result = store_->get(req->key());
         if (result) {
             resp->set_found(true);
-            resp->set_value(*result);
+            resp->set_value(std::move(*result));
         } else {
             resp->set_found(false);
         }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Immutable value bytes with an intrusive reference count, so one buffer
+// can back both a stored entry and the WAL record that logs it. Adopts a
+// std::string without copying it.
+class SharedValue {
+    private:
+        struct Buffer {
+            std::atomic<uint32_t> refs{1};
+            std::string bytes;
+        };
+        Buffer* buffer = nullptr;
+
+        explicit SharedValue(Buffer* buffer) : buffer(buffer) {}
+
+    public:
+        SharedValue() = default;
+        explicit SharedValue(std::string bytes) : buffer(new Buffer) { buffer->bytes = std::move(bytes); }
+        SharedValue(const SharedValue& other) : buffer(other.buffer) {
+            if (buffer) buffer->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        SharedValue(SharedValue&& other) noexcept : buffer(std::exchange(other.buffer, nullptr)) {}
+        SharedValue& operator=(SharedValue other) noexcept {
+            std::swap(buffer, other.buffer);
+            return *this;
+        }
+        ~SharedValue() {
+            if (buffer && buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete buffer;
+        }
+
+        explicit operator bool() const { return buffer != nullptr; }
+        std::string_view view() const { return buffer ? std::string_view(buffer->bytes) : std::string_view(); }
+        size_t size() const { return buffer ? buffer->bytes.size() : 0; }
+
+        // Passes the reference through raw memory: release() gives it up as
+        // an opaque handle, adopt() takes it back, view() reads through it
+        void* release() { return std::exchange(buffer, nullptr); }
+        static SharedValue adopt(void* handle) { return SharedValue(static_cast<Buffer*>(handle)); }
+        static std::string_view view(const void* handle) { return static_cast<const Buffer*>(handle)->bytes; }
+};
+
+// A value handed to put(): borrowed from the caller, or owned when passed
+// as an rvalue std::string, so large values can be kept without a copy
+class PutValue {
+    private:
+        std::string_view borrowed;
+        std::string owned;
+        bool isOwned = false;
+
+    public:
+        PutValue(std::string_view value) : borrowed(value) {}
+        PutValue(const std::string& value) : borrowed(value) {}
+        PutValue(const char* value) : borrowed(value) {}
+        PutValue(std::string&& value) : owned(std::move(value)), isOwned(true) {}
+        PutValue(PutValue&& other) noexcept
+            : borrowed(other.borrowed), owned(std::move(other.owned)), isOwned(other.isOwned) {}
+        PutValue(const PutValue&) = delete;
+        PutValue& operator=(const PutValue&) = delete;
+
+        std::string_view view() const { return isOwned ? std::string_view(owned) : borrowed; }
+        // The bytes in a shared buffer; moves them there when owned
+        SharedValue share() && { return SharedValue(isOwned ? std::move(owned) : std::string(borrowed)); }
+};
@@ -0,0 +1,242 @@
+#include "slab_allocator.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+
+// Sits at the start of its slab; blocks follow from HEADER_SIZE on
+struct SlabAllocator::Slab {
+    SlabAllocator* owner;
+    uint32_t sizeClass;
+    uint32_t capacity;   // Blocks the slab holds
+    uint32_t used = 0;
+    uint32_t carved = 0; // Blocks handed out so far from the untouched tail
+    uint32_t index = 0;  // In its class's slabs
+    bool evacuating = false;
+    bool inPartial = false;
+    void* freeList = nullptr; // Freed blocks, linked through their first bytes
+    Slab* prev = nullptr;     // Partial list
+    Slab* next = nullptr;
+
+    static constexpr size_t HEADER_SIZE = 64;
+    char* blocks() { return reinterpret_cast<char*>(this) + HEADER_SIZE; }
+};
+
+namespace {
+
+// Ahead of a block too big for any class
+struct LargeHeader {
+    SlabAllocator* owner;
+    size_t reserved; // Keeps the block 16-byte aligned
+};
+
+} // namespace
+
+void SlabAllocator::pushPartial(Slab*& head, Slab* slab) {
+    slab->prev = nullptr;
+    slab->next = head;
+    if (head) head->prev = slab;
+    head = slab;
+    slab->inPartial = true;
+}
+
+void SlabAllocator::unlinkPartial(Slab*& head, Slab* slab) {
+    if (!slab->inPartial) return;
+    if (slab->prev) slab->prev->next = slab->next;
+    else head = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->inPartial = false;
+}
+
+size_t SlabAllocator::classFor(size_t bytes) {
+    if (bytes <= 128) return bytes == 0 ? 0 : (bytes - 1) / 16;
+    size_t group = std::bit_width(bytes - 1) - 8;
+    return 8 + group * 8 + (bytes - (128 << group) - 1) / (16 << group);
+}
+
+size_t SlabAllocator::classSize(size_t index) {
+    if (index < 8) return (index + 1) * 16;
+    size_t group = (index - 8) / 8;
+    return (128 << group) + ((index - 8) % 8 + 1) * (16 << group);
+}
+
+SlabAllocator::Slab* SlabAllocator::slabOf(const void* block) {
+    return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(block) & ~(SLAB_SIZE - 1));
+}
+
+SlabAllocator* SlabAllocator::ownerOf(const void* block, size_t bytes) {
+    if (bytes > MAX_BLOCK) return (static_cast<const LargeHeader*>(block) - 1)->owner;
+    return slabOf(block)->owner;
+}
+
+// Maps twice the size and trims it to a SLAB_SIZE-aligned slab, so a
+// block's slab is its address rounded down
+SlabAllocator::Slab* SlabAllocator::mapSlab(size_t index) {
+    void* mapped = mmap(nullptr, 2 * SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) throw std::bad_alloc();
+    uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+    uintptr_t aligned = (start + SLAB_SIZE - 1) & ~(SLAB_SIZE - 1);
+    if (aligned > start) munmap(mapped, aligned - start);
+    if (start + SLAB_SIZE > aligned) munmap(reinterpret_cast<void*>(aligned + SLAB_SIZE), start + SLAB_SIZE - aligned);
+
+    Slab* slab = new (reinterpret_cast<void*>(aligned)) Slab;
+    slab->owner = this;
+    slab->sizeClass = static_cast<uint32_t>(index);
+    slab->capacity = static_cast<uint32_t>((SLAB_SIZE - Slab::HEADER_SIZE) / classSize(index));
+    refs.fetch_add(1, std::memory_order_relaxed);
+    slabCount.fetch_add(1, std::memory_order_relaxed);
+    return slab;
+}
+
+// Takes the slab out of its class. Called with the class's lock held; the
+// caller unmaps it once the lock is released.
+void SlabAllocator::dropSlab(SizeClass& sizeClass, Slab* slab) {
+    unlinkPartial(sizeClass.partial, slab);
+    sizeClass.slabs[slab->index] = sizeClass.slabs.back();
+    sizeClass.slabs[slab->index]->index = slab->index;
+    sizeClass.slabs.pop_back();
+}
+
+void SlabAllocator::unmapSlab(Slab* slab) {
+    munmap(slab, SLAB_SIZE);
+    slabCount.fetch_sub(1, std::memory_order_relaxed);
+    unref();
+}
+
+void SlabAllocator::unref() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+}
+
+void* SlabAllocator::allocate(size_t bytes, size_t external) {
+    if (bytes > MAX_BLOCK) {
+        auto* header = static_cast<LargeHeader*>(::operator new(sizeof(LargeHeader) + bytes));
+        header->owner = this;
+        refs.fetch_add(1, std::memory_order_relaxed);
+        bytesUsed.fetch_add(bytes + external, std::memory_order_relaxed);
+        return header + 1;
+    }
+
+    size_t index = classFor(bytes);
+    SizeClass& sizeClass = classes[index];
+    std::lock_guard<std::mutex> lock(sizeClass.mutex);
+    Slab* slab = sizeClass.partial;
+    if (!slab) {
+        slab = mapSlab(index);
+        slab->index = static_cast<uint32_t>(sizeClass.slabs.size());
+        sizeClass.slabs.push_back(slab);
+        pushPartial(sizeClass.partial, slab);
+    }
+    void* block;
+    if (slab->freeList) {
+        block = slab->freeList;
+        slab->freeList = *static_cast<void**>(block);
+    } else {
+        block = slab->blocks() + slab->carved++ * classSize(index);
+    }
+    if (++slab->used == slab->capacity) unlinkPartial(sizeClass.partial, slab);
+    bytesUsed.fetch_add(bytes + external, std::memory_order_relaxed);
+    slabBytesUsed.fetch_add(classSize(index), std::memory_order_relaxed);
+    return block;
+}
+
+void SlabAllocator::retire(const void* block, size_t bytes, size_t external) {
+    SlabAllocator* owner = ownerOf(block, bytes);
+    owner->bytesUsed.fetch_sub(bytes + external, std::memory_order_relaxed);
+    owner->bytesRetired.fetch_add(bytes + external, std::memory_order_relaxed);
+}
+
+void SlabAllocator::deallocate(void* block, size_t bytes, size_t external, bool retired) {
+    if (bytes > MAX_BLOCK) {
+        auto* header = static_cast<LargeHeader*>(block) - 1;
+        SlabAllocator* owner = header->owner;
+        ::operator delete(header);
+        (retired ? owner->bytesRetired : owner->bytesUsed).fetch_sub(bytes + external, std::memory_order_relaxed);
+        owner->unref();
+        return;
+    }
+    Slab* slab = slabOf(block);
+    slab->owner->freeBlock(slab, block, bytes, external, retired);
+}
+
+void SlabAllocator::freeBlock(Slab* slab, void* block, size_t bytes, size_t external, bool retired) {
+    SizeClass& sizeClass = classes[slab->sizeClass];
+    bool unmap = false;
+    {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        *static_cast<void**>(block) = slab->freeList;
+        slab->freeList = block;
+        bool wasFull = slab->used == slab->capacity;
+        --slab->used;
+        (retired ? bytesRetired : bytesUsed).fetch_sub(bytes + external, std::memory_order_relaxed);
+        slabBytesUsed.fetch_sub(classSize(slab->sizeClass), std::memory_order_relaxed);
+        // An empty slab is kept if it is its class's last, so a class
+        // hovering around one block doesn't map and unmap on every change
+        if (slab->used == 0 &&
+            (slab->evacuating || sizeClass.slabs.size() > 1 || detached.load(std::memory_order_relaxed))) {
+            dropSlab(sizeClass, slab);
+            unmap = true;
+        } else if (wasFull && !slab->evacuating) {
+            pushPartial(sizeClass.partial, slab);
+        }
+    }
+    if (unmap) unmapSlab(slab);
+}
+
+size_t SlabAllocator::beginCompaction() {
+    size_t toEmpty = 0;
+    std::vector<Slab*> empty;
+    for (auto& sizeClass : classes) {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        std::vector<Slab*> targets;
+        size_t live = 0;
+        for (Slab* slab : sizeClass.slabs) {
+            if (slab->evacuating) continue;
+            targets.push_back(slab);
+            live += slab->used;
+        }
+        if (targets.size() < 2) continue;
+
+        // The fullest slabs that can hold every live block stay
+        size_t keep = (live + targets[0]->capacity - 1) / targets[0]->capacity;
+        std::sort(targets.begin(), targets.end(), [](const Slab* a, const Slab* b) { return a->used > b->used; });
+        for (size_t i = keep; i < targets.size(); ++i) {
+            Slab* slab = targets[i];
+            slab->evacuating = true;
+            unlinkPartial(sizeClass.partial, slab);
+            if (slab->used == 0) {
+                dropSlab(sizeClass, slab);
+                empty.push_back(slab);
+            } else {
+                ++toEmpty;
+            }
+        }
+    }
+    for (Slab* slab : empty) unmapSlab(slab);
+    return toEmpty;
+}
+
+bool SlabAllocator::isEvacuating(const void* block, size_t bytes) {
+    return bytes <= MAX_BLOCK && slabOf(block)->evacuating;
+}
+
+// Gives up the Handle's reference. Empty slabs kept for reuse go now;
+// the rest follow as their blocks are freed.
+void SlabAllocator::detach() {
+    detached.store(true, std::memory_order_relaxed);
+    std::vector<Slab*> empty;
+    for (auto& sizeClass : classes) {
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        for (size_t i = sizeClass.slabs.size(); i-- > 0;) {
+            Slab* slab = sizeClass.slabs[i];
+            if (slab->used == 0) {
+                dropSlab(sizeClass, slab);
+                empty.push_back(slab);
+            }
+        }
+    }
+    for (Slab* slab : empty) unmapSlab(slab);
+    unref();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Size-classed slab allocator for one store's entry blocks. Blocks up to
+// MAX_BLOCK bytes are carved from slabs mapped straight from the kernel,
+// one size class per slab, so a block costs its class size and no malloc
+// header, and a slab that empties is unmapped rather than left in malloc's
+// free lists. Larger blocks come from the heap behind a small header naming
+// their allocator.
+//
+// Every block is counted, together with the bytes its entry keeps outside
+// it (a shared value), so getBytesUsed() is exactly what the store's live
+// entries take; blocks retired for deferred freeing move over to
+// getBytesRetired() until they are freed. Blocks freed by removed keys
+// leave holes in their slabs; beginCompaction() marks the emptiest slabs of
+// each class for the owner to move blocks out of, and they are unmapped
+// once the last one is freed.
+//
+// Thread-safe, with a lock per size class. Blocks are freed through the
+// static deallocate(), which finds the allocator from the block itself, so
+// frees deferred by EpochReclaimer need no context. The allocator lives
+// until its Handle is gone and the last of its blocks has been freed.
+class SlabAllocator {
+    public:
+        static constexpr size_t SLAB_SIZE = 256 << 10;
+        static constexpr size_t MAX_BLOCK = 4096;
+
+    private:
+        // Classes are 16 bytes apart up to 128, then eight to each doubling
+        static constexpr size_t CLASS_COUNT = 48;
+
+        struct Slab;
+        struct SizeClass {
+            std::mutex mutex; // Guards the fields below and the headers of its slabs
+            std::vector<Slab*> slabs;
+            Slab* partial = nullptr; // Slabs with free blocks that aren't being emptied
+        };
+
+        std::array<SizeClass, CLASS_COUNT> classes;
+        std::atomic<size_t> bytesUsed{0};
+        std::atomic<size_t> bytesRetired{0};
+        std::atomic<size_t> slabBytesUsed{0}; // Live blocks at their class size
+        std::atomic<size_t> slabCount{0};
+        std::atomic<size_t> refs{1}; // The Handle's, plus one per slab
+        std::atomic<bool> detached{false};
+
+        SlabAllocator() = default;
+        ~SlabAllocator() = default;
+
+        static size_t classFor(size_t bytes);
+        static size_t classSize(size_t index);
+        static Slab* slabOf(const void* block);
+        static SlabAllocator* ownerOf(const void* block, size_t bytes);
+        static void pushPartial(Slab*& head, Slab* slab);
+        static void unlinkPartial(Slab*& head, Slab* slab);
+        Slab* mapSlab(size_t index);
+        static void dropSlab(SizeClass& sizeClass, Slab* slab);
+        void unmapSlab(Slab* slab);
+        void freeBlock(Slab* slab, void* block, size_t bytes, size_t external, bool retired);
+        void unref();
+        void detach();
+
+    public:
+        struct Deleter {
+            void operator()(SlabAllocator* slabs) const { slabs->detach(); }
+        };
+        using Handle = std::unique_ptr<SlabAllocator, Deleter>;
+        static Handle create() { return Handle(new SlabAllocator); }
+
+        SlabAllocator(const SlabAllocator&) = delete;
+        SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+        // A block of `bytes`, counted along with `external` bytes its entry
+        // keeps elsewhere. Both are passed back to retire() and deallocate().
+        void* allocate(size_t bytes, size_t external);
+        // Stops counting a block as used ahead of freeing it, for blocks
+        // that have to wait for readers; deallocate() then says `retired`
+        static void retire(const void* block, size_t bytes, size_t external);
+        static void deallocate(void* block, size_t bytes, size_t external, bool retired = false);
+
+        // Marks for emptying the slabs each class can do without: all but
+        // the fullest ones that have room for every block of the class.
+        // New blocks avoid marked slabs; the caller moves the live ones out.
+        // Empty ones are unmapped at once; returns how many still hold blocks.
+        size_t beginCompaction();
+        // Whether a block of `bytes` sits in a slab marked for emptying
+        static bool isEvacuating(const void* block, size_t bytes);
+
+        size_t getBytesUsed() const { return bytesUsed.load(std::memory_order_relaxed); }
+        size_t getBytesRetired() const { return bytesRetired.load(std::memory_order_relaxed); }
+        size_t getSlabBytes() const { return slabCount.load(std::memory_order_relaxed) * SLAB_SIZE; }
+        // Share of the slab memory not holding live blocks
+        double getFragmentation() const {
+            size_t mapped = getSlabBytes();
+            if (mapped == 0) return 0;
+            return 1.0 - static_cast<double>(slabBytesUsed.load(std::memory_order_relaxed)) / mapped;
+        }
+};
@@ -0,0 +1,221 @@
+#include "snapshot.hpp"
+#include "crc32c.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[6] = {'K', 'V', 'S', 'N', 'A', 'P'};
+constexpr uint8_t kVersion = 2;
+constexpr uint8_t kOldestVersion = 1; // Still read
+constexpr size_t kHeaderCrcOffset = 40;
+constexpr size_t kBlockHeaderSize = 8;
+
+std::string errnoMessage(const std::string& what, int error = errno) {
+    return what + ": " + std::strerror(error);
+}
+
+} // namespace
+
+//
+// SnapshotWriter
+//
+
+SnapshotWriter::SnapshotWriter(const std::string& path, SnapshotKind kind, SnapshotCompression compression)
+    : path(path), kind(kind), compression(compression) {
+    if (!ValueCodec::isAvailable(compression)) {
+        throw std::runtime_error(std::string("Snapshot compression ") + ValueCodec::name(compression) +
+                                 " is not built in");
+    }
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error(errnoMessage("Failed to open snapshot file " + path));
+    }
+    buffer.reserve(BLOCK_SIZE + 64);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (fd >= 0) ::close(fd);
+}
+
+void SnapshotWriter::writeAt(const char* data, size_t length, uint64_t position) {
+    while (length > 0) {
+        ssize_t n = ::pwrite(fd, data, length, static_cast<off_t>(position));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(errnoMessage("Failed to write snapshot file " + path));
+        }
+        data += n;
+        length -= static_cast<size_t>(n);
+        position += static_cast<uint64_t>(n);
+    }
+}
+
+void SnapshotWriter::add(std::string_view key, std::string_view value, uint64_t expiryMs, bool compressed) {
+    if (openBlock == SIZE_MAX) {
+        // Room for the block header, filled in by sealBlock()
+        openBlock = buffer.size();
+        buffer.append(kBlockHeaderSize, '\0');
+    }
+    putVarint(buffer, key.size());
+    putVarint(buffer, static_cast<uint64_t>(value.size()) << 1 | compressed);
+    putVarint(buffer, expiryMs);
+    buffer.append(key);
+    buffer.append(value);
+    ++entryCount;
+    if (buffer.size() - openBlock >= BLOCK_SIZE) sealBlock();
+}
+
+void SnapshotWriter::sealBlock() {
+    if (openBlock == SIZE_MAX) return;
+    auto size = static_cast<uint32_t>(buffer.size() - openBlock - kBlockHeaderSize);
+    storeFixed32(buffer.data() + openBlock, size);
+    storeFixed32(buffer.data() + openBlock + 4, size);
+    openBlock = SIZE_MAX;
+}
+
+// Replaces each buffered block with its compressed form where that is
+// smaller, so storedSize < rawSize marks exactly the compressed blocks
+void SnapshotWriter::compressBlocks() {
+    compressed.clear();
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        uint32_t rawSize = getFixed32(buffer.data() + offset);
+        std::string_view raw(buffer.data() + offset + kBlockHeaderSize, rawSize);
+        size_t header = compressed.size();
+        compressed.append(kBlockHeaderSize, '\0');
+        if (!ValueCodec::compressBlock(compression, raw, compressed) ||
+            compressed.size() - header - kBlockHeaderSize >= rawSize) {
+            compressed.resize(header + kBlockHeaderSize);
+            compressed.append(raw);
+        }
+        storeFixed32(compressed.data() + header, rawSize);
+        storeFixed32(compressed.data() + header + 4,
+                     static_cast<uint32_t>(compressed.size() - header - kBlockHeaderSize));
+        offset += kBlockHeaderSize + rawSize;
+    }
+    buffer.swap(compressed);
+}
+
+void SnapshotWriter::flush() {
+    sealBlock();
+    if (buffer.empty()) return;
+    if (compression != SnapshotCompression::None) compressBlocks();
+    bodyCrc = crc32c(buffer.data(), buffer.size(), bodyCrc);
+    writeAt(buffer.data(), buffer.size(), HEADER_SIZE + bodySize);
+    bodySize += buffer.size();
+    buffer.clear();
+}
+
+void SnapshotWriter::finish(uint64_t lsn) {
+    flush();
+
+    char header[HEADER_SIZE] = {};
+    std::memcpy(header, kMagic, sizeof(kMagic));
+    header[6] = static_cast<char>(kVersion);
+    header[7] = static_cast<char>(compression);
+    storeFixed64(header + 8, lsn);
+    storeFixed64(header + 16, entryCount);
+    storeFixed64(header + 24, bodySize);
+    storeFixed32(header + 32, bodyCrc);
+    header[36] = static_cast<char>(kind);
+    storeFixed32(header + kHeaderCrcOffset, crc32c(header, kHeaderCrcOffset));
+    writeAt(header, sizeof(header), 0);
+
+    if (::close(fd) != 0) {
+        fd = -1;
+        throw std::runtime_error(errnoMessage("Failed to close snapshot file " + path));
+    }
+    fd = -1;
+}
+
+//
+// SnapshotReader
+//
+
+std::unique_ptr<SnapshotReader> SnapshotReader::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return nullptr;
+        throw std::runtime_error(errnoMessage("Failed to open snapshot file " + path));
+    }
+    std::unique_ptr<SnapshotReader> reader(new SnapshotReader());
+    reader->fd = fd;
+    reader->path = path;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error(errnoMessage("Failed to stat snapshot file " + path));
+    }
+    reader->length = static_cast<size_t>(st.st_size);
+    if (reader->length == 0) return reader;
+
+    void* mapping = ::mmap(nullptr, reader->length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error(errnoMessage("Failed to map snapshot file " + path));
+    }
+    reader->data = static_cast<const char*>(mapping);
+    ::madvise(mapping, reader->length, MADV_SEQUENTIAL);
+
+    // Text snapshots start with "KVSNAP\t" or directly with a key
+    const char* header = reader->data;
+    if (reader->length < SnapshotWriter::HEADER_SIZE ||
+        std::memcmp(header, kMagic, sizeof(kMagic)) != 0 || header[6] == '\t') {
+        return reader;
+    }
+    reader->binary = true;
+
+    if (getFixed32(header + kHeaderCrcOffset) != crc32c(header, kHeaderCrcOffset)) {
+        reader->corrupt("header checksum mismatch");
+    }
+    reader->version = static_cast<uint8_t>(header[6]);
+    if (reader->version < kOldestVersion || reader->version > kVersion) {
+        reader->corrupt("unsupported version " + std::to_string(reader->version));
+    }
+    reader->compression = static_cast<SnapshotCompression>(header[7]);
+    if (static_cast<uint8_t>(header[7]) > static_cast<uint8_t>(SnapshotCompression::Zstd)) {
+        reader->corrupt("unsupported compression " + std::to_string(static_cast<uint8_t>(header[7])));
+    }
+    if (!ValueCodec::isAvailable(reader->compression)) {
+        reader->corrupt(std::string("compressed with ") + ValueCodec::name(reader->compression) +
+                        ", which this build lacks");
+    }
+    if (static_cast<uint8_t>(header[36]) > static_cast<uint8_t>(SnapshotKind::Delta)) {
+        reader->corrupt("unknown kind " + std::to_string(static_cast<uint8_t>(header[36])));
+    }
+    reader->kind = static_cast<SnapshotKind>(header[36]);
+    reader->lsn = getFixed64(header + 8);
+    reader->entryCount = getFixed64(header + 16);
+    reader->bodySize = getFixed64(header + 24);
+    if (reader->bodySize != reader->length - SnapshotWriter::HEADER_SIZE) {
+        reader->corrupt("body size mismatch");
+    }
+    if (getFixed32(header + 32) != crc32c(header + SnapshotWriter::HEADER_SIZE, reader->bodySize)) {
+        reader->corrupt("body checksum mismatch");
+    }
+    return reader;
+}
+
+SnapshotReader::~SnapshotReader() {
+    if (data) ::munmap(const_cast<char*>(data), length);
+    if (fd >= 0) ::close(fd);
+}
+
+void SnapshotReader::decompressBlock(const char* stored, uint32_t storedSize, uint32_t rawSize,
+                                     std::string& block) const {
+    if (compression == SnapshotCompression::None || storedSize > rawSize) corrupt("block sizes don't match");
+    block.resize(rawSize);
+    if (!ValueCodec::decompressBlock(compression, std::string_view(stored, storedSize), block.data(), rawSize)) {
+        corrupt("block failed to decompress");
+    }
+}
+
+void SnapshotReader::corrupt(const std::string& what) const {
+    throw std::runtime_error("Corrupt snapshot " + path + ": " + what);
+}
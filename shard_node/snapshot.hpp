@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "coding.hpp"
+#include "value_codec.hpp"
+
+// Binary snapshot file, version 2 (integers little-endian):
+//
+//   header (48 bytes):
+//     "KVSNAP" | u8 version | u8 compression | u64 lsn | u64 entryCount |
+//     u64 bodySize | u32 bodyCrc | u8 kind | 3 reserved | u32 headerCrc | u32 reserved
+//   body: blocks of
+//     u32 rawSize | u32 storedSize | storedSize bytes
+//   block contents: entries of
+//     varint keyLen | varint valueLen << 1 | compressed | varint expiryMs | key | value
+//
+// compressed is set for values stored as a ValueCodec frame. Version 1
+// files, from before value compression, have a plain valueLen. expiryMs is
+// the system_clock deadline in ms since the Unix epoch, or 0 for keys
+// without a TTL. A full snapshot holds every key; a delta holds the keys
+// changed since the previous snapshot in its chain, with expiryMs
+// SNAPSHOT_REMOVED for keys that were removed. The header is written last,
+// so a file with a valid header is complete. bodyCrc is CRC32C over the
+// whole body and headerCrc over the header bytes before it. A block whose
+// storedSize equals its rawSize is stored as is; a smaller one is the block
+// compressed with the file's codec, kept only where that saved bytes.
+// compression uses ValueCompression's codec numbers.
+
+using SnapshotCompression = ValueCompression;
+
+enum class SnapshotKind : uint8_t {
+    Full = 0,
+    Delta = 1,
+};
+
+constexpr uint64_t SNAPSHOT_REMOVED = UINT64_MAX;
+
+// Packs entries into blocks and writes them to `path`, replacing any
+// existing file. add() only buffers, so callers can collect entries under a
+// lock and flush() after releasing it; blocks are compressed in flush() too.
+// Throws std::runtime_error if the compression codec isn't built in. Not
+// thread-safe.
+class SnapshotWriter {
+    private:
+        int fd = -1;
+        std::string path;
+        SnapshotKind kind;
+        SnapshotCompression compression;
+        std::string buffer;          // Encoded blocks not yet written
+        std::string compressed;      // The same blocks compressed, by flush()
+        size_t openBlock = SIZE_MAX; // Offset of the block being filled
+        uint64_t entryCount = 0;
+        uint64_t bodySize = 0;
+        uint32_t bodyCrc = 0;
+
+        void writeAt(const char* data, size_t length, uint64_t position);
+        void sealBlock();
+        void compressBlocks();
+
+    public:
+        static constexpr size_t HEADER_SIZE = 48;
+        static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+        explicit SnapshotWriter(const std::string& path, SnapshotKind kind = SnapshotKind::Full,
+                                SnapshotCompression compression = SnapshotCompression::None);
+        SnapshotWriter(const SnapshotWriter&) = delete;
+        SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+        ~SnapshotWriter();
+
+        void add(std::string_view key, std::string_view value, uint64_t expiryMs, bool compressed = false);
+        // Ends the current block and writes everything buffered
+        void flush();
+        // Writes the last block and the header naming the WAL LSN the
+        // snapshot covers. The file is complete but not yet fsynced.
+        void finish(uint64_t lsn);
+};
+
+// A snapshot file mapped read-only into memory.
+class SnapshotReader {
+    private:
+        int fd = -1;
+        std::string path;
+        const char* data = nullptr;
+        size_t length = 0;
+        bool binary = false;
+        uint8_t version = 0;
+        SnapshotCompression compression = SnapshotCompression::None;
+        SnapshotKind kind = SnapshotKind::Full;
+        uint64_t lsn = 0;
+        uint64_t entryCount = 0;
+        uint64_t bodySize = 0;
+
+        SnapshotReader() = default;
+        [[noreturn]] void corrupt(const std::string& what) const;
+        // Restores a compressed block into `block`
+        void decompressBlock(const char* stored, uint32_t storedSize, uint32_t rawSize, std::string& block) const;
+
+    public:
+        // Null if the file doesn't exist. Throws std::runtime_error if it is
+        // a binary snapshot whose header or checksums don't match, or whose
+        // compression codec isn't built in.
+        static std::unique_ptr<SnapshotReader> open(const std::string& path);
+        SnapshotReader(const SnapshotReader&) = delete;
+        SnapshotReader& operator=(const SnapshotReader&) = delete;
+        ~SnapshotReader();
+
+        // False for the text snapshots written before the binary format
+        bool isBinary() const { return binary; }
+        SnapshotKind getKind() const { return kind; }
+        uint64_t getLSN() const { return lsn; }
+        uint64_t getEntryCount() const { return entryCount; }
+
+        // Calls apply(key, value, expiryMs, compressed) for every entry. The
+        // views point into the mapping, or a decompressed block, and are
+        // only valid during the call.
+        template <typename Apply>
+        void forEach(Apply&& apply) const;
+};
+
+template <typename Apply>
+void SnapshotReader::forEach(Apply&& apply) const {
+    const char* p = data + SnapshotWriter::HEADER_SIZE;
+    const char* bodyEnd = p + bodySize;
+    std::string block; // The current block, if it was compressed
+    while (p < bodyEnd) {
+        if (bodyEnd - p < 8) corrupt("truncated block header");
+        uint32_t rawSize = getFixed32(p);
+        uint32_t storedSize = getFixed32(p + 4);
+        p += 8;
+        if (static_cast<uint64_t>(bodyEnd - p) < storedSize) corrupt("truncated block");
+
+        const char* entry = p;
+        const char* end = p + storedSize;
+        p = end;
+        if (storedSize != rawSize) {
+            decompressBlock(entry, storedSize, rawSize, block);
+            entry = block.data();
+            end = entry + block.size();
+        }
+        while (entry < end) {
+            uint64_t keyLen, valueField, expiryMs;
+            if (!getVarint(entry, end, keyLen) || !getVarint(entry, end, valueField) ||
+                !getVarint(entry, end, expiryMs)) {
+                corrupt("malformed entry");
+            }
+            uint64_t valueLen = version >= 2 ? valueField >> 1 : valueField;
+            bool compressed = version >= 2 && (valueField & 1);
+            if (static_cast<uint64_t>(end - entry) < keyLen ||
+                static_cast<uint64_t>(end - entry) - keyLen < valueLen) {
+                corrupt("malformed entry");
+            }
+            std::string_view key(entry, keyLen);
+            std::string_view value(entry + keyLen, valueLen);
+            entry += keyLen + valueLen;
+            apply(key, value, expiryMs, compressed);
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#include "timing_wheel.hpp"
+
+#include <algorithm>
+
+namespace {
+
+constexpr std::chrono::milliseconds kTick{1};
+
+// Bytes a string keeps on the heap, none for a short one stored inline
+size_t heapBytes(const std::string& s) {
+    return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+} // namespace
+
+TimingWheel::TimingWheel(Clock::time_point start) : start(start) {}
+
+// Rounded up, so the tick a deadline falls in is never collected early
+uint64_t TimingWheel::tickFor(Clock::time_point deadline) const {
+    if (deadline <= start) return 0;
+    auto elapsed = deadline - start;
+    return static_cast<uint64_t>((elapsed + kTick - Clock::duration(1)) / kTick);
+}
+
+void TimingWheel::link(Timer** list, Timer* timer) {
+    timer->prev = nullptr;
+    timer->next = *list;
+    if (*list) (*list)->prev = timer;
+    *list = timer;
+    timer->list = list;
+}
+
+void TimingWheel::unlink(Timer* timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        *timer->list = timer->next;
+    }
+    if (timer->next) timer->next->prev = timer->prev;
+    timer->prev = timer->next = nullptr;
+    timer->list = nullptr;
+}
+
+void TimingWheel::place(Timer* timer) {
+    uint64_t tick = tickFor(timer->deadline);
+    if (tick <= currentTick) {
+        link(&ready, timer);
+        return;
+    }
+    // Past the last level's reach: park as far out as it goes; the entry is
+    // re-filed by its real deadline when that slot comes around
+    constexpr uint64_t reach = uint64_t{1} << (SLOT_BITS * LEVELS);
+    if (tick - currentTick >= reach) {
+        tick = currentTick + reach - 1;
+    }
+    unsigned level = 0;
+    while ((tick - currentTick) >> (SLOT_BITS * (level + 1))) {
+        ++level;
+    }
+    link(&wheels[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)], timer);
+}
+
+// Re-files the level's current slot into the levels below
+void TimingWheel::cascade(unsigned level) {
+    Timer*& slot = wheels[level][(currentTick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    Timer* timer = slot;
+    slot = nullptr;
+    while (timer) {
+        Timer* next = timer->next;
+        place(timer);
+        timer = next;
+    }
+}
+
+void TimingWheel::schedule(std::string_view key, Clock::time_point deadline) {
+    auto it = timers.find(key);
+    if (it != timers.end()) {
+        Timer* timer = it->second.get();
+        unlink(timer);
+        timer->deadline = deadline;
+        place(timer);
+        return;
+    }
+    auto timer = std::make_unique<Timer>();
+    timer->key.assign(key);
+    timer->deadline = deadline;
+    keyBytes += heapBytes(timer->key);
+    Timer* filed = timer.get();
+    timers.emplace(filed->key, std::move(timer));
+    place(filed);
+}
+
+void TimingWheel::cancel(std::string_view key) {
+    auto it = timers.find(key);
+    if (it == timers.end()) return;
+    unlink(it->second.get());
+    keyBytes -= heapBytes(it->second->key);
+    timers.erase(it);
+}
+
+void TimingWheel::collectDue(Clock::time_point now, std::vector<Entry>& due, size_t limit) {
+    uint64_t target = now > start ? static_cast<uint64_t>((now - start) / kTick) : 0;
+    if (timers.empty()) {
+        currentTick = std::max(currentTick, target);
+        return;
+    }
+
+    while (true) {
+        while (ready && due.size() < limit) {
+            Timer* timer = ready;
+            unlink(timer);
+            auto node = timers.extract(timer->key);
+            keyBytes -= heapBytes(timer->key);
+            due.push_back(Entry{std::move(timer->key), timer->deadline});
+        }
+        if (due.size() >= limit || currentTick >= target) return;
+
+        ++currentTick;
+        // A higher level's slot is due whenever the ticks below it wrap
+        for (unsigned level = 1; level < LEVELS; ++level) {
+            if (currentTick & ((uint64_t{1} << (SLOT_BITS * level)) - 1)) break;
+            cascade(level);
+        }
+        cascade(0);
+    }
+}
+
+size_t TimingWheel::memoryBytes() const {
+    // An index node holds the view, the pointer, the cached hash and a link
+    constexpr size_t perTimer = sizeof(Timer) + sizeof(std::string_view) + 3 * sizeof(void*);
+    return timers.size() * perTimer + keyBytes + timers.bucket_count() * sizeof(void*);
+}
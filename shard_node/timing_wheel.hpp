@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timing wheel indexing keys by TTL deadline, so expiry only
+// touches keys that are due. Four levels of 256 slots at 1 ms per tick
+// reach about 49 days; later deadlines park in the last level and are
+// re-filed as they come closer.
+//
+// A key has at most one entry. Scheduling it again moves the entry to the
+// new deadline and cancel() drops it, both in constant time, so a key
+// rewritten with a TTL over and over still costs one entry. Not
+// thread-safe.
+class TimingWheel {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Entry {
+            std::string key;
+            Clock::time_point deadline;
+        };
+
+    private:
+        static constexpr unsigned LEVELS = 4;
+        static constexpr unsigned SLOT_BITS = 8;
+        static constexpr uint64_t SLOTS = 1u << SLOT_BITS;
+
+        // A key's entry, linked into the slot (or ready list) it is filed in
+        struct Timer {
+            std::string key;
+            Clock::time_point deadline;
+            Timer* prev = nullptr;
+            Timer* next = nullptr;
+            Timer** list = nullptr; // Head of the list holding it
+        };
+
+        Clock::time_point start;
+        uint64_t currentTick = 0; // Every tick up to this one has been collected
+        std::array<std::array<Timer*, SLOTS>, LEVELS> wheels{};
+        Timer* ready = nullptr; // Due, not yet handed out
+        // Keyed by a view of the timer's own key, which never moves
+        std::unordered_map<std::string_view, std::unique_ptr<Timer>> timers;
+        size_t keyBytes = 0; // Heap bytes of keys too long to store inline
+
+        uint64_t tickFor(Clock::time_point deadline) const;
+        void place(Timer* timer);
+        void cascade(unsigned level);
+        static void link(Timer** list, Timer* timer);
+        static void unlink(Timer* timer);
+
+    public:
+        explicit TimingWheel(Clock::time_point start = Clock::now());
+        // Slots point back into the wheel
+        TimingWheel(const TimingWheel&) = delete;
+        TimingWheel& operator=(const TimingWheel&) = delete;
+
+        // Files the key under `deadline`, replacing any entry it had
+        void schedule(std::string_view key, Clock::time_point deadline);
+        void cancel(std::string_view key);
+
+        // Moves up to `limit` entries whose deadline is at or before `now`
+        // into `due`. Entries left over stay queued for the next call.
+        void collectDue(Clock::time_point now, std::vector<Entry>& due, size_t limit);
+
+        size_t size() const { return timers.size(); }
+        // Heap bytes held: entries, their keys and the index over them
+        size_t memoryBytes() const;
+};
@@ -0,0 +1,151 @@
+#include "value_codec.hpp"
+#include "coding.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#ifdef KV_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef KV_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// Favours speed, as values are compressed on the put path
+[[maybe_unused]] constexpr int ZSTD_LEVEL = 1;
+
+// LZ4 takes int sizes
+[[maybe_unused]] constexpr size_t LZ4_MAX_VALUE = 0x7E000000; // LZ4_MAX_INPUT_SIZE
+
+#ifdef KV_HAVE_ZSTD
+// A context costs more to set up than a small value does to compress, so
+// each thread keeps one of each
+ZSTD_CCtx* zstdCompressor() {
+    thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    return context.get();
+}
+
+ZSTD_DCtx* zstdDecompressor() {
+    thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    return context.get();
+}
+#endif
+
+} // namespace
+
+bool ValueCodec::isAvailable(ValueCompression codec) {
+    switch (codec) {
+        case ValueCompression::None:
+            return true;
+        case ValueCompression::LZ4:
+#ifdef KV_HAVE_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case ValueCompression::Zstd:
+#ifdef KV_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+const char* ValueCodec::name(ValueCompression codec) {
+    switch (codec) {
+        case ValueCompression::None: return "none";
+        case ValueCompression::LZ4: return "lz4";
+        case ValueCompression::Zstd: return "zstd";
+    }
+    return "unknown";
+}
+
+bool ValueCodec::compressBlock(ValueCompression codec, std::string_view input, std::string& output) {
+    [[maybe_unused]] size_t start = output.size();
+    switch (codec) {
+#ifdef KV_HAVE_LZ4
+        case ValueCompression::LZ4: {
+            if (input.size() > LZ4_MAX_VALUE) return false;
+            int bound = LZ4_compressBound(static_cast<int>(input.size()));
+            output.resize(start + bound);
+            int n = LZ4_compress_default(input.data(), output.data() + start, static_cast<int>(input.size()), bound);
+            output.resize(start + std::max(n, 0));
+            return n > 0;
+        }
+#endif
+#ifdef KV_HAVE_ZSTD
+        case ValueCompression::Zstd: {
+            size_t bound = ZSTD_compressBound(input.size());
+            output.resize(start + bound);
+            size_t n = ZSTD_compressCCtx(zstdCompressor(), output.data() + start, bound, input.data(), input.size(),
+                                         ZSTD_LEVEL);
+            output.resize(start + (ZSTD_isError(n) ? 0 : n));
+            return !ZSTD_isError(n);
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+bool ValueCodec::decompressBlock(ValueCompression codec, std::string_view input, char* output, size_t size) {
+    switch (codec) {
+#ifdef KV_HAVE_LZ4
+        case ValueCompression::LZ4: {
+            if (size > LZ4_MAX_VALUE || input.size() > LZ4_MAX_VALUE) return false;
+            int n = LZ4_decompress_safe(input.data(), output, static_cast<int>(input.size()), static_cast<int>(size));
+            return n >= 0 && static_cast<size_t>(n) == size;
+        }
+#endif
+#ifdef KV_HAVE_ZSTD
+        case ValueCompression::Zstd: {
+            size_t n = ZSTD_decompressDCtx(zstdDecompressor(), output, size, input.data(), input.size());
+            return !ZSTD_isError(n) && n == size;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+std::optional<std::string> ValueCodec::compress(ValueCompression codec, std::string_view value) {
+    if (codec == ValueCompression::None || !isAvailable(codec)) return std::nullopt;
+    std::string stored;
+    stored.push_back(static_cast<char>(codec));
+    putVarint(stored, value.size());
+    if (!compressBlock(codec, value, stored)) return std::nullopt;
+    if (stored.size() > value.size() - value.size() / 8) return std::nullopt;
+    // Sized for the worst case until now; stores count size(), not capacity
+    stored.shrink_to_fit();
+    return stored;
+}
+
+bool ValueCodec::canDecompress(std::string_view stored) {
+    if (stored.empty()) return false;
+    auto codec = static_cast<ValueCompression>(stored[0]);
+    return codec != ValueCompression::None && isAvailable(codec);
+}
+
+std::string ValueCodec::decompress(std::string_view stored) {
+    const char* p = stored.data();
+    const char* end = p + stored.size();
+    uint64_t rawSize;
+    if (p == end) throw std::runtime_error("Empty compressed value");
+    auto codec = static_cast<ValueCompression>(*p++);
+    if (!getVarint(p, end, rawSize)) throw std::runtime_error("Malformed compressed value");
+    if (!canDecompress(stored)) {
+        throw std::runtime_error("Value compressed with codec " + std::to_string(static_cast<uint8_t>(codec)) +
+                                 ", which this build lacks");
+    }
+
+    std::string value(rawSize, '\0');
+    if (!decompressBlock(codec, std::string_view(p, static_cast<size_t>(end - p)), value.data(), rawSize)) {
+        throw std::runtime_error("Corrupt compressed value");
+    }
+    return value;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Codec a store compresses its large values with (KVStoreOptions)
+enum class ValueCompression : uint8_t {
+    None = 0,
+    LZ4 = 1,
+    Zstd = 2,
+};
+
+// Compresses single values for storage. A compressed value is framed as
+//
+//   u8 codec | varint rawSize | compressed bytes
+//
+// and kept that way in the entry, the WAL record and the snapshot, each of
+// which marks it compressed; only a get decompresses it. The frame names
+// its codec, so a store reads values written under another setting as long
+// as the codec is built in. LZ4 and Zstd are built in when CMake finds
+// their libraries (KV_HAVE_LZ4, KV_HAVE_ZSTD).
+class ValueCodec {
+    public:
+        static bool isAvailable(ValueCompression codec);
+        static const char* name(ValueCompression codec);
+
+        // The framed value, or nullopt if the codec isn't built in or
+        // doesn't save at least an eighth of the bytes
+        static std::optional<std::string> compress(ValueCompression codec, std::string_view value);
+        // Throws std::runtime_error if the frame is malformed or its codec
+        // isn't built in
+        static std::string decompress(std::string_view stored);
+        // Whether decompress() can read the frame's codec; checked as values
+        // are loaded, so a store fails at open rather than on a get
+        static bool canDecompress(std::string_view stored);
+
+        // Unframed, for callers that record the codec and both sizes
+        // themselves (snapshot blocks). compressBlock appends the compressed
+        // bytes to `output` and returns false, leaving it as it was, if the
+        // codec isn't built in or fails. decompressBlock returns true only
+        // if `input` restores exactly `size` bytes into `output`.
+        static bool compressBlock(ValueCompression codec, std::string_view input, std::string& output);
+        static bool decompressBlock(ValueCompression codec, std::string_view input, char* output, size_t size);
+};
@@ -1,98 +1,732 @@
 #include "wal.hpp"
+#include "coding.hpp"
+#include "crc32c.hpp"
+#include "wal_writer_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <stdexcept>
+
+#include <sys/uio.h>
+
+namespace {
+
+constexpr char kMagic[5] = {'K', 'V', 'W', 'A', 'L'};
+constexpr size_t kLSNSize = 8;
+constexpr size_t kFlagsOffset = 6;
+constexpr uint8_t kRecycledFlag = 0x01; // The file held an older segment before
+constexpr size_t kLSNDigits = 20; // Enough for any uint64_t
+
+std::string sparePath(const std::string& baseName, uint64_t id) {
+    return baseName + ".spare." + std::to_string(id);
+}
+
+size_t varintLength(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+} // namespace
 
-WriteAheadLog::WriteAheadLog(const std::string& filename) 
-    : logFileName(filename)  {
-    walStream.open(filename, std::ios::app);
-    if (!walStream.is_open()) {
-        throw std::runtime_error("Failed to open WAL file: " + filename);
+WriteAheadLog::WriteAheadLog(const std::string& baseName, const WALOptions& options,
+                             const WALReplayResult* recovered)
+    : baseName(baseName), options(options), writerState(&ownWriterState), writerPool(options.writerPool)  {
+    size_t capacity = std::bit_ceil(std::max<size_t>(options.ringCapacity, 2));
+    ring = std::make_unique<RingSlot[]>(capacity);
+    ringMask = capacity - 1;
+    batchThreshold = std::min(BATCH_SIZE, capacity);
+
+    for (uint64_t id : findNumberedFiles(baseName, ".spare.")) {
+        spares.push_back(sparePath(baseName, id));
+        nextSpareId = id + 1;
+    }
+
+    // Continue after the newest record on disk, appending to the newest segment
+    auto existing = findSegments(baseName);
+    uint64_t lastLSN = recovered ? recovered->lastLSN : 0;
+    if (existing.empty()) {
+        startSegment(lastLSN + 1);
+    } else {
+        uint64_t endOffset = recovered ? recovered->endOffset : 0;
+        if (!recovered) {
+            auto scanned = scanSegment(existing.back(), UINT64_MAX, nullptr);
+            lastLSN = scanned.lastLSN;
+            endOffset = scanned.endOffset;
+        }
+        lastLSN = std::max(lastLSN, existing.back().firstLSN - 1);
+        segments.assign(existing.begin(), existing.end());
+        file = WALFile::open(segments.back().path, options.ioEngine);
+        allocatedSize = file->size();
+
+        if (endOffset < HEADER_SIZE) {
+            // A segment whose header never made it to disk gets a new one
+            file->truncate(0);
+            allocatedSize = 0;
+            writeHeader(segments.back().firstLSN);
+        } else {
+            // Anything past the intact records was trimmed by the scan or is
+            // a reused file's old contents, so appends simply continue there
+            file->seek(endOffset);
+        }
     }
-    
-    // Start batch writer thread
+    lastSequence = lastLSN;
+    consumedSequence = lastLSN;
+    writtenSequence = lastLSN;
+    syncedSequence = lastLSN;
+    nextToWrite = lastLSN + 1;
+
+    // Hand the log to a shared pool worker, or start its own writer thread
     shutdownFlag = false;
-    batchWriterThread = std::thread(&WriteAheadLog::batchWriterLoop, this);
+    currentBatch.reserve(MAX_BATCH);
+    if (writerPool) {
+        writerSlot = writerPool->attach(this);
+        writerState = &writerPool->writerState(writerSlot);
+    } else {
+        batchWriterThread = std::thread(&WriteAheadLog::batchWriterLoop, this);
+    }
 }
 
 WriteAheadLog::~WriteAheadLog() {
     shutdownFlag = true;
-    batchCondition.notify_all();
-    
-    if (batchWriterThread.joinable()) {
-        batchWriterThread.join();
+
+    if (writerPool) {
+        // Once detached no pool worker touches this log; drain it here
+        writerPool->detach(this, writerSlot);
+        while (hasPendingRecords()) {
+            commitPending();
+        }
+    } else {
+        wakeWriter();
+        if (batchWriterThread.joinable()) {
+            batchWriterThread.join();
+        }
     }
-    
-    if (walStream.is_open()) {
-        walStream.close();
+    finishLog();
+
+    // Give back the unused preallocated tail; appends allocate again
+    std::lock_guard<std::mutex> lock(logMutex);
+    try {
+        file->truncate(file->size());
+    } catch (const std::exception& e) {
+        std::cerr << "[WAL] " << e.what() << "\n";
     }
 }
 
-void WriteAheadLog::writeToFile(const std::string& entry) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    if (walStream.is_open()) {
-        walStream << entry << std::endl;
-        walStream.flush(); // Ensure data is written to disk
+namespace {
+
+// Everything up to the value; `inlineValue` is empty for a shared value
+std::string encodeHead(WALOp op, std::string_view key, size_t valueSize,
+                       std::string_view inlineValue, int64_t expiryMs) {
+    uint64_t ttl = expiryMs > 0 ? static_cast<uint64_t>(expiryMs) : 0;
+    std::string record;
+    record.reserve(4 + 1 + varintLength(key.size()) + varintLength(valueSize) +
+                   varintLength(ttl) + key.size() + inlineValue.size() + kLSNSize);
+    record.append(4, '\0'); // CRC placeholder
+    record.push_back(static_cast<char>(op));
+    putVarint(record, key.size());
+    putVarint(record, valueSize);
+    putVarint(record, ttl);
+    record.append(key);
+    record.append(inlineValue);
+    return record;
+}
+
+} // namespace
+
+std::string WriteAheadLog::encodeRecord(WALOp op, std::string_view key,
+                                        std::string_view value, int64_t expiryMs) {
+    std::string record = encodeHead(op, key, value.size(), value, expiryMs);
+    // Checksum everything but the LSN; stampLSN() extends it once the
+    // writer knows the record's place in the log
+    storeFixed32(record.data(), crc32c(record.data() + 4, record.size() - 4));
+    record.append(kLSNSize, '\0');
+    return record;
+}
+
+EncodedRecord WriteAheadLog::encodeRecord(WALOp op, std::string_view key,
+                                          const SharedValue& value, int64_t expiryMs) {
+    std::string head = encodeHead(op, key, value.size(), {}, expiryMs);
+    uint32_t crc = crc32c(head.data() + 4, head.size() - 4);
+    crc = crc32c(value.view().data(), value.size(), crc);
+    storeFixed32(head.data(), crc);
+    head.append(kLSNSize, '\0');
+    return {std::move(head), value};
+}
+
+void WriteAheadLog::stampLSN(std::string& record, uint64_t lsn) {
+    char* lsnBytes = record.data() + record.size() - kLSNSize;
+    storeFixed64(lsnBytes, lsn);
+    storeFixed32(record.data(), crc32c(lsnBytes, kLSNSize, getFixed32(record.data())));
+}
+
+std::string WriteAheadLog::segmentPath(const std::string& baseName, uint64_t firstLSN) {
+    char digits[kLSNDigits + 1];
+    std::snprintf(digits, sizeof(digits), "%020llu", static_cast<unsigned long long>(firstLSN));
+    return baseName + "." + digits;
+}
+
+std::vector<WriteAheadLog::Segment> WriteAheadLog::findSegments(const std::string& baseName) {
+    std::vector<Segment> found;
+    for (uint64_t firstLSN : findNumberedFiles(baseName, ".", kLSNDigits)) {
+        found.push_back({firstLSN, segmentPath(baseName, firstLSN)});
+    }
+    return found;
+}
+
+std::vector<std::string> WriteAheadLog::listSegments(const std::string& baseName) {
+    std::vector<std::string> paths;
+    for (auto& segment : findSegments(baseName)) {
+        paths.push_back(std::move(segment.path));
+    }
+    return paths;
+}
+
+void WriteAheadLog::removeLog(const std::string& baseName) {
+    for (const auto& segment : findSegments(baseName)) {
+        std::filesystem::remove(segment.path);
     }
+    for (uint64_t id : findNumberedFiles(baseName, ".spare.")) {
+        std::filesystem::remove(sparePath(baseName, id));
+    }
+}
+
+namespace {
+
+constexpr size_t kScanChunk = 1 << 20;           // Bytes read at a time during recovery
+constexpr size_t kMaxRecordHead = 4 + 1 + 3 * 10; // crc, op and three varints
+
+bool isZero(const char* p, size_t n) {
+    return std::all_of(p, p + n, [](char c) { return c == 0; });
 }
 
-void WriteAheadLog::append(const std::string& entry) {
-    writeToFile(entry);
+// Reads a segment front to back a chunk at a time, so a scan that stops at
+// the end of the records never reads the preallocated space after them
+class SegmentReader {
+    private:
+        std::ifstream in;
+        uint64_t fileSize = 0;
+        std::string buffer;
+        size_t pos = 0;            // Next unconsumed byte of buffer
+        uint64_t bufferOffset = 0; // File offset of buffer[0]
+
+    public:
+        explicit SegmentReader(const std::string& path) : in(path, std::ios::binary) {
+            if (!in.is_open()) return;
+            in.seekg(0, std::ios::end);
+            fileSize = static_cast<uint64_t>(in.tellg());
+            in.seekg(0, std::ios::beg);
+        }
+
+        bool isOpen() const { return in.is_open(); }
+        uint64_t size() const { return fileSize; }
+        uint64_t remaining() const { return fileSize - bufferOffset - pos; }
+        const char* data() const { return buffer.data() + pos; }
+        void skip(size_t n) { pos += n; }
+
+        // Buffers the next `n` bytes, or as many as the file has left, and
+        // returns how many are available at data()
+        size_t fill(size_t n) {
+            n = static_cast<size_t>(std::min<uint64_t>(n, remaining()));
+            size_t have = buffer.size() - pos;
+            if (have >= n) return n;
+            buffer.erase(0, pos);
+            bufferOffset += pos;
+            pos = 0;
+            uint64_t unread = fileSize - bufferOffset - have;
+            size_t more = static_cast<size_t>(std::min<uint64_t>(std::max(n, kScanChunk) - have, unread));
+            buffer.resize(have + more);
+            in.read(buffer.data() + have, static_cast<std::streamsize>(more));
+            buffer.resize(have + static_cast<size_t>(in.gcount()));
+            // A file that shrank under us ends where the read did
+            if (buffer.size() < have + more) fileSize = bufferOffset + buffer.size();
+            return std::min(n, buffer.size());
+        }
+};
+
+} // namespace
+
+WALReplayResult WriteAheadLog::scanSegment(const Segment& segment, uint64_t afterLSN,
+                                           const std::function<void(const WALRecord&)>& apply) {
+    WALReplayResult result;
+    result.lastLSN = segment.firstLSN - 1;
+    SegmentReader reader(segment.path);
+    if (!reader.isOpen()) return result;
+
+    size_t validBytes = 0;
+    bool recycled = false;
+    // Set when scanning stops at zeros: space preallocated but never written
+    size_t headerBytes = reader.fill(HEADER_SIZE);
+    bool zeros = isZero(reader.data(), headerBytes);
+    if (headerBytes == HEADER_SIZE && !zeros) {
+        const char* header = reader.data();
+        if (std::memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+            throw std::runtime_error("Not a binary WAL segment: " + segment.path);
+        }
+        if (static_cast<uint8_t>(header[5]) != FORMAT_VERSION) {
+            throw std::runtime_error("Unsupported WAL format version in " + segment.path + ": " +
+                                     std::to_string(static_cast<uint8_t>(header[5])));
+        }
+        if (getFixed64(header + 8) != segment.firstLSN) {
+            throw std::runtime_error("WAL segment header does not match its name: " + segment.path);
+        }
+        recycled = static_cast<uint8_t>(header[kFlagsOffset]) & kRecycledFlag;
+        reader.skip(HEADER_SIZE);
+        validBytes = HEADER_SIZE;
+    }
+
+    // Set when scanning stops at an intact record from before this segment
+    bool stale = false;
+
+    while (validBytes > 0) {
+        size_t available = reader.fill(kMaxRecordHead);
+        if (available == 0) break;
+        const char* p = reader.data();
+        // No record starts with a zero CRC and op
+        if (isZero(p, std::min<size_t>(available, 5))) {
+            zeros = true;
+            break;
+        }
+        if (available < 5) break;
+        const char* end = p + available;
+        const char* cursor = p + 4;
+        auto op = static_cast<WALOp>(static_cast<uint8_t>(*cursor++));
+
+        uint64_t keyLen, valueLen, ttl;
+        if (!getVarint(cursor, end, keyLen) ||
+            !getVarint(cursor, end, valueLen) ||
+            !getVarint(cursor, end, ttl)) break;
+        size_t head = static_cast<size_t>(cursor - p);
+        uint64_t left = reader.remaining() - head;
+        if (left < kLSNSize || keyLen > left - kLSNSize || valueLen > left - kLSNSize - keyLen) break;
+
+        size_t length = head + static_cast<size_t>(keyLen + valueLen) + kLSNSize;
+        if (reader.fill(length) < length) break;
+        p = reader.data();
+        cursor = p + head;
+        const char* recordEnd = p + length;
+        if (crc32c(p + 4, length - 4) != getFixed32(p)) break;
+        if (op != WALOp::Put && op != WALOp::Remove && op != WALOp::PutCompressed) break;
+        uint64_t lsn = getFixed64(recordEnd - kLSNSize);
+        if (lsn <= result.lastLSN) {
+            stale = true;
+            break;
+        }
+
+        if (apply && lsn > afterLSN) {
+            WALRecord record{lsn, op,
+                             std::string_view(cursor, keyLen),
+                             std::string_view(cursor + keyLen, valueLen),
+                             static_cast<int64_t>(ttl)};
+            apply(record);
+            ++result.records;
+        }
+
+        result.lastLSN = lsn;
+        reader.skip(length);
+        validBytes += length;
+    }
+
+    // An intact record with an older LSN, or anything at all in a reused
+    // file, is left over from the file's previous life. Those bytes stay
+    // where they are: every record in them predates this segment's first
+    // LSN, so they can never pass for newer records, and appends overwrite
+    // them. Zeros are preallocated space, given back without reading the
+    // rest of it. Anything else is a record torn partway through. Both are
+    // cut off so later appends start on a clean boundary and nothing written
+    // out of order behind the zeros can surface later.
+    result.endOffset = validBytes;
+    if (stale || recycled || reader.size() == validBytes) return result;
+    if (!zeros) {
+        result.tornTail = true;
+        std::cerr << "[WAL Recovery] Discarding " << (reader.size() - validBytes)
+                  << " bytes after the last intact record in " << segment.path << "\n";
+    }
+    std::filesystem::resize_file(segment.path, validBytes);
+    return result;
 }
 
-void WriteAheadLog::appendBatch(const std::string& entry) {
-    if (shutdownFlag) return;
-    
-    std::unique_lock<std::mutex> lock(batchMutex);
-    batchBuffer.push_back(entry);
-    
-    // Trigger write if batch is full
-    if (batchBuffer.size() >= BATCH_SIZE) {
-        batchCondition.notify_one();
+WALReplayResult WriteAheadLog::replay(const std::string& baseName,
+                                      const std::function<void(const WALRecord&)>& apply,
+                                      uint64_t afterLSN) {
+    WALReplayResult total;
+    auto segments = findSegments(baseName);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        // Every record in a segment precedes the next segment's first LSN
+        if (i + 1 < segments.size() && segments[i + 1].firstLSN - 1 <= afterLSN) continue;
+
+        auto result = scanSegment(segments[i], afterLSN, apply);
+        total.records += result.records;
+        total.lastLSN = std::max(total.lastLSN, result.lastLSN);
+        total.endOffset = result.endOffset;
+        if (result.tornTail) {
+            total.tornTail = true;
+            // Later segments would leave a hole in the log; drop them too
+            for (size_t j = i + 1; j < segments.size(); ++j) {
+                std::cerr << "[WAL Recovery] Discarding segment " << segments[j].path
+                          << " after a corrupt record\n";
+                std::filesystem::remove(segments[j].path);
+            }
+            break;
+        }
     }
+    return total;
 }
 
-void WriteAheadLog::flush() {
-    std::lock_guard<std::mutex> lock(logMutex);
-    if (walStream.is_open()) {
-        walStream.flush();
+void WriteAheadLog::writeHeader(uint64_t firstLSN, bool recycled) {
+    char header[HEADER_SIZE] = {};
+    std::memcpy(header, kMagic, sizeof(kMagic));
+    header[5] = static_cast<char>(FORMAT_VERSION);
+    header[kFlagsOffset] = static_cast<char>(recycled ? kRecycledFlag : 0);
+    storeFixed64(header + 8, firstLSN);
+    struct iovec iov{header, HEADER_SIZE};
+    file->write(&iov, 1, false);
+}
+
+void WriteAheadLog::startSegment(uint64_t firstLSN) {
+    // Cut the old segment at its last record and make it durable before
+    // records land in the next one, so a crash can never leave a hole or
+    // stale bytes in the middle of the log
+    if (file) {
+        file->truncate(file->size());
+        file->sync();
+    }
+
+    Segment segment{firstLSN, segmentPath(baseName, firstLSN)};
+    if (!spares.empty()) {
+        // Reuse a retired segment: its blocks are already allocated and
+        // written, so overwriting them needs no metadata updates. The header
+        // is made durable before the rename so name and header always agree.
+        std::string spare = std::move(spares.back());
+        spares.pop_back();
+        file = WALFile::open(spare, options.ioEngine);
+        allocatedSize = file->size();
+        file->seek(0);
+        writeHeader(firstLSN, true);
+        file->sync();
+        std::filesystem::rename(spare, segment.path);
+        recycleCount.fetch_add(1, std::memory_order_relaxed);
     } else {
-        throw std::runtime_error("WAL stream is not open.");
+        file = WALFile::open(segment.path, options.ioEngine);
+        file->truncate(0);
+        allocatedSize = 0;
+        writeHeader(firstLSN);
+    }
+    syncParentDirectory(segment.path);
+    segments.push_back(std::move(segment));
+}
+
+// Reserves blocks for the newest segment up to `end`, rounded up to a
+// chunk, so appends rarely grow the file and an idle or crashed segment
+// holds at most one chunk of unused space. Called with logMutex held.
+void WriteAheadLog::reserveSpace(uint64_t end) {
+    if (!options.preallocate || end <= allocatedSize) return;
+    uint64_t chunk = std::max<uint64_t>(options.preallocateChunk, 1);
+    uint64_t target = std::min((end + chunk - 1) / chunk * chunk,
+                               std::max<uint64_t>(end, options.segmentSize));
+    // Without fallocate support writes just grow the file; don't retry
+    // until the next chunk
+    file->allocate(target);
+    allocatedSize = target;
+}
+
+void WriteAheadLog::discardSegments(const std::vector<Segment>& discarded) {
+    for (const auto& segment : discarded) {
+        std::error_code ec;
+        if (spares.size() < options.recycledSegments) {
+            std::string spare = sparePath(baseName, nextSpareId++);
+            std::filesystem::rename(segment.path, spare, ec);
+            if (!ec) {
+                spares.push_back(std::move(spare));
+                continue;
+            }
+        }
+        std::filesystem::remove(segment.path, ec);
+    }
+}
+
+void WriteAheadLog::append(const std::string& record) {
+    waitFor(appendBatch(record), Durability::Flush);
+}
+
+uint64_t WriteAheadLog::appendBatch(EncodedRecord record) {
+    uint64_t sequence = reserveSequence();
+    submit(sequence, std::move(record));
+    return sequence;
+}
+
+uint64_t WriteAheadLog::reserveSequence() {
+    if (shutdownFlag) return 0;
+    return lastSequence.fetch_add(1, std::memory_order_seq_cst) + 1;
+}
+
+void WriteAheadLog::submit(uint64_t sequence, EncodedRecord record) {
+    if (sequence == 0) return;
+
+    // Backpressure: the slot is free once the writer has consumed the record
+    // one lap behind us
+    uint64_t capacity = ringMask + 1;
+    uint64_t consumed = consumedSequence.load(std::memory_order_acquire);
+    if (sequence > consumed + capacity) {
+        backpressureWaits.fetch_add(1, std::memory_order_relaxed);
+        wakeWriter();
+        while (sequence > consumed + capacity) {
+            consumedSequence.wait(consumed, std::memory_order_acquire);
+            consumed = consumedSequence.load(std::memory_order_acquire);
+        }
+    }
+
+    RingSlot& slot = ring[sequence & ringMask];
+    slot.record = std::move(record);
+    slot.sequence.store(sequence, std::memory_order_seq_cst);
+
+    // Wake a parked writer so it starts its batch timer, a sleeping one once
+    // a full batch is queued, and either immediately if a durability waiter
+    // may be blocked behind this record
+    if (commitRequested.load(std::memory_order_seq_cst) ||
+        writerState->parked.load(std::memory_order_seq_cst) ||
+        (sequence - consumed >= batchThreshold && writerState->sleeping.load(std::memory_order_relaxed))) {
+        wakeWriter();
+    }
+}
+
+void WriteAheadLog::wakeWriter() {
+    if (writerPool) {
+        writerPool->wake(writerSlot);
+        return;
+    }
+    { std::lock_guard<std::mutex> lock(batchMutex); }
+    batchCondition.notify_one();
+}
+
+void WriteAheadLog::waitFor(uint64_t sequence, Durability durability) {
+    if (durability == Durability::None || sequence == 0) return;
+
+    auto& target = durability == Durability::Sync ? syncedSequence : writtenSequence;
+    if (target.load(std::memory_order_acquire) >= sequence) return;
+
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        commitRequested.store(true, std::memory_order_seq_cst);
+        if (durability == Durability::Sync) {
+            syncRequested = std::max(syncRequested, sequence);
+        }
+    }
+    wakeWriter();
+
+    std::unique_lock<std::mutex> lock(commitMutex);
+    commitCondition.wait(lock, [&] {
+        return target.load(std::memory_order_acquire) >= sequence || !writeError.empty();
+    });
+    if (target.load(std::memory_order_acquire) < sequence) {
+        throw std::runtime_error(writeError);
+    }
+}
+
+void WriteAheadLog::flush() {
+    if (!file) {
+        throw std::runtime_error("WAL file is not open.");
     }
+    waitFor(lastSequence.load(), Durability::Sync);
 }
 
 void WriteAheadLog::reset() {
+    // The newest segment keeps its name: its first LSN stays a lower bound
+    // for whatever is written next
+    std::lock_guard<std::mutex> lock(logMutex);
+    file->truncate(HEADER_SIZE);
+    allocatedSize = HEADER_SIZE;
+    discardSegments({segments.begin(), segments.end() - 1});
+    segments.erase(segments.begin(), segments.end() - 1);
+}
+
+size_t WriteAheadLog::retireSegments(uint64_t checkpointLSN) {
     std::lock_guard<std::mutex> lock(logMutex);
-    walStream.close();
-    walStream.open(logFileName, std::ios::trunc);
+    std::vector<Segment> retired;
+    while (segments.size() > 1 && segments[1].firstLSN - 1 <= checkpointLSN) {
+        retired.push_back(std::move(segments.front()));
+        segments.pop_front();
+    }
+    discardSegments(retired);
+    return retired.size();
+}
+
+size_t WriteAheadLog::getSegmentCount() {
+    std::lock_guard<std::mutex> lock(logMutex);
+    return segments.size();
+}
+
+void WriteAheadLog::writeBatchToFile(const std::vector<EncodedRecord>& batch, uint64_t firstLSN, bool sync) {
+    std::vector<struct iovec> iov;
+    iov.reserve(batch.size() * 3);
+    std::lock_guard<std::mutex> lock(logMutex);
+    size_t begin = 0;
+    while (begin < batch.size()) {
+        // Fill the current segment and rotate once the next record would
+        // overflow it; a record bigger than a segment gets one to itself
+        uint64_t size = file->size();
+        size_t end = begin;
+        while (end < batch.size() &&
+               (size + batch[end].size() <= options.segmentSize || size == HEADER_SIZE)) {
+            size += batch[end].size();
+            ++end;
+        }
+        if (end == begin) {
+            startSegment(firstLSN + begin);
+            continue;
+        }
+
+        iov.clear();
+        for (size_t i = begin; i < end; ++i) {
+            const EncodedRecord& record = batch[i];
+            char* bytes = const_cast<char*>(record.bytes.data());
+            if (!record.value) {
+                iov.push_back({bytes, record.bytes.size()});
+                continue;
+            }
+            // A shared value is written from the store's buffer
+            size_t head = record.bytes.size() - kLSNSize;
+            iov.push_back({bytes, head});
+            iov.push_back({const_cast<char*>(record.value.view().data()), record.value.size()});
+            iov.push_back({bytes + head, kLSNSize});
+        }
+        reserveSpace(size);
+        file->write(iov.data(), iov.size(), sync && end == batch.size());
+        begin = end;
+    }
+    if (sync) syncCount.fetch_add(1, std::memory_order_relaxed);
 }
 
-void WriteAheadLog::writeBatchToFile(const std::vector<std::string>& batch) {
+void WriteAheadLog::syncToDisk() {
     std::lock_guard<std::mutex> lock(logMutex);
-    for (const auto& entry : batch) {
-        walStream << entry << std::endl;
+    file->sync();
+    syncCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WriteAheadLog::publish(uint64_t written, uint64_t synced, const std::string& error) {
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        writtenSequence.store(written, std::memory_order_release);
+        syncedSequence.store(synced, std::memory_order_release);
+        if (!error.empty()) writeError = error;
+    }
+    commitCondition.notify_all();
+}
+
+bool WriteAheadLog::slotReady(uint64_t sequence) const {
+    return ring[sequence & ringMask].sequence.load(std::memory_order_acquire) == sequence;
+}
+
+bool WriteAheadLog::hasPendingRecords() const {
+    return lastSequence.load(std::memory_order_seq_cst) >= nextToWrite;
+}
+
+bool WriteAheadLog::hasWork() const {
+    return hasPendingRecords() || commitRequested.load(std::memory_order_seq_cst);
+}
+
+bool WriteAheadLog::commitReady() const {
+    bool headReady = slotReady(nextToWrite);
+    uint64_t queued = lastSequence.load(std::memory_order_relaxed) - (nextToWrite - 1);
+    if (headReady && queued >= batchThreshold) return true;
+
+    // A Sync waiter whose record is already written only needs the fdatasync
+    bool syncPending = std::min(syncRequested, nextToWrite - 1) > syncedSequence.load();
+    return commitRequested.load(std::memory_order_seq_cst) && (headReady || syncPending);
+}
+
+bool WriteAheadLog::commitPending() {
+    // Take the contiguous run of published records; a sequence that is
+    // reserved but not yet submitted holds back everything after it
+    while (currentBatch.size() < MAX_BATCH && slotReady(nextToWrite)) {
+        EncodedRecord& record = ring[nextToWrite & ringMask].record;
+        stampLSN(record.bytes, nextToWrite);
+        currentBatch.push_back(std::move(record));
+        ++nextToWrite;
+    }
+    uint64_t batchEnd = nextToWrite - 1;
+    if (!currentBatch.empty()) {
+        consumedSequence.store(batchEnd, std::memory_order_release);
+        consumedSequence.notify_all();
+    }
+
+    uint64_t syncTarget;
+    {
+        // Waiters register under batchMutex, so reading the sync target and
+        // clearing the request together cannot lose a wakeup. The request
+        // stays set while records are outstanding so the producer filling
+        // a gap wakes us for the waiters behind it.
+        std::lock_guard<std::mutex> lock(batchMutex);
+        syncTarget = std::min(syncRequested, batchEnd);
+        if (!hasPendingRecords()) commitRequested.store(false, std::memory_order_seq_cst);
+    }
+
+    uint64_t synced = syncedSequence.load();
+    if (currentBatch.empty() && syncTarget <= synced) return false;
+
+    std::string error;
+    try {
+        // One fdatasync covers every record written so far, so all Sync
+        // waiters that queued up behind the previous commit share it. It is
+        // issued together with the write so engines can chain the two.
+        bool sync = syncTarget > synced;
+        if (!currentBatch.empty()) {
+            writeBatchToFile(currentBatch, batchEnd - currentBatch.size() + 1, sync);
+        } else if (sync) {
+            syncToDisk();
+        }
+        if (sync) synced = batchEnd;
+    } catch (const std::exception& e) {
+        error = e.what();
+        std::cerr << "[WAL] " << error << "\n";
+    }
+    publish(error.empty() ? batchEnd : writtenSequence.load(), synced, error);
+    currentBatch.clear();
+    return true;
+}
+
+void WriteAheadLog::finishLog() {
+    // Everything is written; make it durable before the log is closed
+    uint64_t written = writtenSequence.load();
+    std::string error;
+    try {
+        if (syncedSequence.load() < written) syncToDisk();
+    } catch (const std::exception& e) {
+        error = e.what();
     }
-    walStream.flush();
+    publish(written, error.empty() ? written : syncedSequence.load(), error);
 }
 
 void WriteAheadLog::batchWriterLoop() {
-    while (!shutdownFlag) {
-        std::unique_lock<std::mutex> lock(batchMutex);
-        
-        // Wait for batch to fill or timeout
-        batchCondition.wait_for(lock, std::chrono::milliseconds(BATCH_TIMEOUT_MS), 
-            [this] { return batchBuffer.size() >= BATCH_SIZE || shutdownFlag; });
-        
-        if (!batchBuffer.empty()) {
-            std::vector<std::string> currentBatch;
-            currentBatch.swap(batchBuffer);
-            lock.unlock();
-            
-            writeBatchToFile(currentBatch);
-        }
-    }
-    
-    // Flush remaining entries on shutdown
-    std::lock_guard<std::mutex> lock(batchMutex);
-    if (!batchBuffer.empty()) {
-        writeBatchToFile(batchBuffer);
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(batchMutex);
+
+            // Park without a deadline while nothing is queued; producers wake
+            // us when the first record arrives. Setting `parked` before the
+            // check pairs with the producer's publish-then-check.
+            writerState->sleeping.store(true, std::memory_order_relaxed);
+            writerState->parked.store(true, std::memory_order_seq_cst);
+            if (!hasWork() && !shutdownFlag) {
+                batchCondition.wait(lock, [this] { return hasWork() || shutdownFlag.load(); });
+            }
+            writerState->parked.store(false, std::memory_order_seq_cst);
+
+            // Wait for batch to fill, a durability waiter, or timeout
+            batchCondition.wait_for(lock, std::chrono::milliseconds(BATCH_TIMEOUT_MS),
+                [this] { return commitReady() || shutdownFlag; });
+            writerState->sleeping.store(false, std::memory_order_relaxed);
+        }
+
+        if (!commitPending() && shutdownFlag && !hasPendingRecords()) break;
     }
 }
@@ -1,41 +1,269 @@
 #pragma once
 
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <functional>
 #include <mutex>
+#include <memory>
 #include <vector>
 #include <condition_variable>
 #include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <deque>
 #include <thread>
 
+#include "durability.hpp"
+#include "shared_value.hpp"
+#include "wal_io.hpp"
+
+// Operation stored in a WAL record.
+enum class WALOp : uint8_t {
+    Put = 1,
+    Remove = 2,
+    // A put whose value is a ValueCodec frame
+    PutCompressed = 3,
+};
+
+// Decoded view of a WAL record. Key and value point into the replay buffer
+// and are only valid for the duration of the replay callback.
+struct WALRecord {
+    uint64_t lsn;
+    WALOp op;
+    std::string_view key;
+    std::string_view value;
+    int64_t expiryMs; // Absolute system_clock deadline, ms since the Unix epoch; 0 = no TTL
+};
+
+// An encoded record on its way to the log. A large value can stay in a
+// buffer shared with the store instead of being copied into `bytes`; it is
+// then written between the last 8 bytes of `bytes`, the LSN, and the rest.
+struct EncodedRecord {
+    std::string bytes;
+    SharedValue value;
+
+    EncodedRecord(std::string bytes = {}) : bytes(std::move(bytes)) {}
+    EncodedRecord(std::string bytes, SharedValue value) : bytes(std::move(bytes)), value(std::move(value)) {}
+    size_t size() const { return bytes.size() + value.size(); }
+};
+
+struct WALReplayResult {
+    size_t records = 0;      // Records applied (LSN above the checkpoint)
+    uint64_t lastLSN = 0;    // LSN of the newest intact record in the log
+    uint64_t endOffset = 0;  // Where the intact records of the newest segment end
+    bool tornTail = false;   // A record was cut off partway through (a crash mid-write)
+};
+
+class WALWriterPool;
+
+struct WALOptions {
+    size_t ringCapacity = 4096;          // Rounded up to a power of two
+    WALWriterPool* writerPool = nullptr; // Drain on a shared pool thread instead of our own
+    WALIOEngine ioEngine = WALIOEngine::PWrite;
+    size_t segmentSize = 64 << 20;       // Rotate to a new segment past this many bytes
+    bool preallocate = true;             // fallocate segments ahead of the appends
+    size_t preallocateChunk = 1 << 20;   // Bytes reserved at a time, up to segmentSize
+    size_t recycledSegments = 4;         // Retired segments kept for reuse instead of deleted
+};
+
+// Sleep state of whichever thread drains a log: its own writer thread or a
+// WALWriterPool worker shared with other logs. Producers read it to decide
+// whether a wakeup is needed.
+struct WALWriterState {
+    std::atomic<bool> sleeping{false}; // Waiting for a batch, up to BATCH_TIMEOUT_MS
+    std::atomic<bool> parked{false};   // Nothing queued; waiting without a deadline
+};
+
+//
+// A log is a series of segment files named <baseName>.<first LSN, 20 digits>.
+// Every record carries its LSN (log sequence number), which increases by one
+// per record for the lifetime of the log. A snapshot records the LSN it
+// covers; replay skips everything up to it and retireSegments() deletes the
+// segments it fully covers.
+//
+// On-disk format (version 2), all integers little-endian:
+//
+//   segment header : "KVWAL" | u8 version | u8 flags | u8 reserved
+//                    | u64 first LSN
+//   record         : u32 crc32c | u8 op | varint keyLen | varint valueLen
+//                    | varint expiryMs | key bytes | value bytes | u64 lsn
+//
+// The CRC covers everything after the crc field, so a record is either
+// replayed whole or treated as the torn tail of the log. The LSN goes last
+// so the writer can stamp it by extending the CRC over eight more bytes.
+//
+// Segments are preallocated a chunk at a time ahead of the appends, and
+// retired segments are renamed to <baseName>.spare.<n> and reused, so
+// appends overwrite blocks the file already owns instead of growing it. A
+// segment therefore ends at the first record that is zero-filled, fails
+// its CRC, or has an LSN that doesn't increase (leftovers from the file's
+// previous life). Recovery stops reading there: a zero-filled tail is
+// unused preallocation and is trimmed. A reused segment sets flag 0x01 in
+// its header, so bytes after its last record are known to be old contents
+// and are not reported as a torn tail.
+//
 class WriteAheadLog {
     private:
-        std::string logFileName;
-        std::ofstream walStream;
-        std::mutex logMutex; // Mutex for thread-safe access
-        
-        // Batch WAL components
-        std::vector<std::string> batchBuffer;
+        struct Segment {
+            uint64_t firstLSN;
+            std::string path;
+        };
+
+        std::string baseName;
+        WALOptions options;
+        std::unique_ptr<WALFile> file;   // The newest segment
+        uint64_t allocatedSize = 0;      // Bytes of `file` its blocks already cover
+        std::deque<Segment> segments;    // Oldest first; back() is open in `file`
+        std::vector<std::string> spares; // Retired segment files ready for reuse
+        uint64_t nextSpareId = 0;
+        std::atomic<uint64_t> recycleCount{0};
+        std::mutex logMutex;             // Serializes access to file, segments and spares
+
+        // Submission ring: a bounded multi-producer / single-consumer queue.
+        // Record `seq` lives in slot seq & ringMask. Producers reserve a
+        // sequence with one atomic increment, wait until the writer has freed
+        // that slot's previous occupant (backpressure when the ring is full),
+        // fill it and publish by storing `seq` into the slot. The writer
+        // consumes slots strictly in sequence order. Sequence numbers are the
+        // records' LSNs.
+        struct RingSlot {
+            std::atomic<uint64_t> sequence{0}; // Sequence of the record held, 0 = never filled
+            EncodedRecord record;
+        };
+        std::unique_ptr<RingSlot[]> ring;
+        size_t ringMask;
+        size_t batchThreshold;                     // min(BATCH_SIZE, ring capacity)
+        std::atomic<uint64_t> lastSequence{0};     // Newest reserved sequence
+        std::atomic<uint64_t> consumedSequence{0}; // Newest sequence taken by the writer
+        std::atomic<uint64_t> backpressureWaits{0};
+        uint64_t nextToWrite = 1;                  // Writer only
+        std::vector<EncodedRecord> currentBatch;   // Writer only
+
+        // Writer sleep/wake. Producers only wake the writer when it is parked
+        // and the first record arrives, when a full batch is queued, or when a
+        // durability waiter is held up behind their record. The writer is
+        // either this log's own thread or a shared WALWriterPool worker.
+        uint64_t syncRequested = 0;               // Highest sequence a Sync waiter is blocked on (batchMutex)
+        std::atomic<bool> commitRequested{false}; // A waiter wants the batch written now
+        WALWriterState ownWriterState;
+        WALWriterState* writerState;
+        WALWriterPool* writerPool = nullptr;
+        size_t writerSlot = 0;
         std::mutex batchMutex;
         std::condition_variable batchCondition;
         std::atomic<bool> shutdownFlag{false};
         std::thread batchWriterThread;
-        
-        static constexpr size_t BATCH_SIZE = 100; // Write after 50 operations
+
+        // Group commit: waiters block until the writer publishes their sequence
+        std::atomic<uint64_t> writtenSequence{0};
+        std::atomic<uint64_t> syncedSequence{0};
+        std::atomic<uint64_t> syncCount{0};
+        std::string writeError;
+        std::mutex commitMutex;
+        std::condition_variable commitCondition;
+
+        static constexpr size_t BATCH_SIZE = 100; // Write after 100 operations
+        static constexpr size_t MAX_BATCH = 1024; // Records per writev commit
         static constexpr int BATCH_TIMEOUT_MS = 10; // Or after 10ms
-        
+
         // Internal methods
-        void writeToFile(const std::string& entry);
-        void writeBatchToFile(const std::vector<std::string>& batch);
+        static std::string segmentPath(const std::string& baseName, uint64_t firstLSN);
+        static std::vector<Segment> findSegments(const std::string& baseName);
+        static WALReplayResult scanSegment(const Segment& segment, uint64_t afterLSN,
+                                           const std::function<void(const WALRecord&)>& apply);
+        static void stampLSN(std::string& record, uint64_t lsn);
+        void writeHeader(uint64_t firstLSN, bool recycled = false);
+        void startSegment(uint64_t firstLSN);
+        void reserveSpace(uint64_t end);
+        void discardSegments(const std::vector<Segment>& discarded);
+        void writeBatchToFile(const std::vector<EncodedRecord>& batch, uint64_t firstLSN, bool sync);
+        void syncToDisk();
+        void publish(uint64_t written, uint64_t synced, const std::string& error);
+        bool commitReady() const;
+        bool slotReady(uint64_t sequence) const;
+        bool hasPendingRecords() const;
+        bool hasWork() const;
+        void wakeWriter();
+        bool commitPending();
+        void finishLog();
         void batchWriterLoop();
-        
+
+        friend class WALWriterPool;
+
     public:
-        WriteAheadLog(const std::string& filename);
+        static constexpr uint8_t FORMAT_VERSION = 2;
+        static constexpr size_t HEADER_SIZE = 16;
+
+        // Opens the log, appending to its newest segment. `recovered` is the
+        // result of a replay() just done on the same log; passing it saves
+        // rescanning the newest segment for its last LSN.
+        WriteAheadLog(const std::string& baseName, const WALOptions& options = {},
+                      const WALReplayResult* recovered = nullptr);
 
         ~WriteAheadLog();
-        void append(const std::string& entry);
-        void appendBatch(const std::string& entry);
+
+        // Encodes a single binary record; the result is passed to append/appendBatch,
+        // which stamp its LSN.
+        static std::string encodeRecord(WALOp op, std::string_view key,
+                                        std::string_view value = {}, int64_t expiryMs = 0);
+        // The same record, referencing the value rather than copying it
+        static EncodedRecord encodeRecord(WALOp op, std::string_view key,
+                                          const SharedValue& value, int64_t expiryMs = 0);
+
+        // Replays every intact record with an LSN above `afterLSN`, in log
+        // order, skipping segments that hold nothing newer. A torn or corrupt
+        // record stops the replay: it and everything after it are discarded
+        // so later appends start from a clean record boundary.
+        static WALReplayResult replay(const std::string& baseName,
+                                      const std::function<void(const WALRecord&)>& apply,
+                                      uint64_t afterLSN = 0);
+
+        // Segment files of the log at `baseName`, oldest first
+        static std::vector<std::string> listSegments(const std::string& baseName);
+        // Deletes every segment and spare of the log at `baseName`
+        static void removeLog(const std::string& baseName);
+
+        // Writes the record and waits until it has reached the OS.
+        void append(const std::string& record);
+
+        // Queues the record for the group-commit writer and returns its
+        // sequence number; pass it to waitFor() to wait for durability.
+        uint64_t appendBatch(EncodedRecord record);
+
+        // Two-phase append: reserve a sequence number (a single atomic
+        // increment, cheap enough to do under the caller's lock so the log
+        // order matches the order of its updates), then submit the encoded
+        // record for that sequence after the lock is released. Every reserved
+        // sequence must be submitted, or later records are never written.
+        // submit() blocks while the ring is full.
+        uint64_t reserveSequence();
+        void submit(uint64_t sequence, EncodedRecord record);
+
+        // Blocks until `sequence` is durable at the requested level. All
+        // waiters covered by the same commit share one write and one fdatasync.
+        void waitFor(uint64_t sequence, Durability durability);
+
+        // Waits until everything queued so far is fdatasync'ed.
         void flush();
+        // Discards every record written so far by starting a fresh segment
+        // and deleting the others.
         void reset();
-};
\ No newline at end of file
+
+        // Newest LSN handed out. Read it while the caller's writers are
+        // excluded to get the LSN a consistent snapshot covers.
+        uint64_t getLastLSN() const { return lastSequence.load(); }
+
+        // Deletes segments whose records all have LSN <= checkpointLSN, i.e.
+        // are covered by a durable snapshot. The newest segment is kept.
+        // Returns the number of segments deleted.
+        size_t retireSegments(uint64_t checkpointLSN);
+        size_t getSegmentCount();
+        // Segments started by reusing a retired segment's file
+        uint64_t getRecycleCount() const { return recycleCount.load(); }
+
+        uint64_t getSyncCount() const { return syncCount.load(); }
+        uint64_t getBackpressureWaits() const { return backpressureWaits.load(); }
+        // Engine actually in use; IOUring falls back to PWrite when unsupported
+        WALIOEngine getIOEngine() const { return file->engine(); }
+        uint64_t getIOSyscallCount() const { return file->getSyscallCount(); }
+};
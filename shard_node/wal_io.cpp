@@ -0,0 +1,447 @@
+#include "wal_io.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr unsigned kRingEntries = 8;
+constexpr size_t kStagingBufferSize = 1 << 20;
+constexpr uint64_t kWriteTag = 1;
+constexpr uint64_t kSyncTag = 2;
+constexpr size_t kMaxNumberDigits = 20; // Enough for any uint64_t
+
+std::string errnoMessage(const std::string& what, int error = errno) {
+    return what + ": " + std::strerror(error);
+}
+
+int ioUringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int ringFd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, ringFd, opcode, arg, count));
+}
+
+// Whether io_uring can be used at all (old kernel, seccomp, or disabled by
+// the kernel.io_uring_disabled sysctl).
+bool ioUringSupported() {
+    static const bool supported = [] {
+        struct io_uring_params params{};
+        int ringFd = ioUringSetup(1, &params);
+        if (ringFd < 0) return false;
+        ::close(ringFd);
+        return true;
+    }();
+    return supported;
+}
+
+// An io_uring instance with one registered staging buffer. Each writer
+// thread gets its own, so memory scales with writer threads rather than
+// with the number of logs.
+class IOUring {
+    private:
+        int ringFd = -1;
+        void* sqRing = MAP_FAILED;
+        size_t sqRingSize = 0;
+        void* cqRing = MAP_FAILED;
+        size_t cqRingSize = 0;
+        struct io_uring_sqe* sqes = nullptr;
+        size_t sqesSize = 0;
+        unsigned* sqTail = nullptr;
+        unsigned sqMask = 0;
+        unsigned* sqArray = nullptr;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned cqMask = 0;
+        struct io_uring_cqe* cqes = nullptr;
+        char* buffer = nullptr;
+        unsigned queued = 0;
+
+        IOUring() = default;
+        bool init();
+        struct io_uring_sqe& nextSqe();
+
+    public:
+        struct Result {
+            int written = 0;    // Write result: bytes or -errno
+            int synced = 0;     // fdatasync result: 0 or -errno
+            unsigned enterCalls = 0;
+        };
+
+        ~IOUring();
+        // The calling thread's ring, created on first use; null if setup fails
+        static IOUring* forThisThread();
+
+        char* stagingBuffer() { return buffer; }
+        // Writes the first `length` staging bytes at `position`, with an
+        // fdatasync linked behind the write if `sync`.
+        Result write(int fd, uint64_t position, size_t length, bool sync);
+        Result sync(int fd);
+        Result submitAndWait();
+};
+
+bool IOUring::init() {
+    struct io_uring_params params{};
+    ringFd = ioUringSetup(kRingEntries, &params);
+    if (ringFd < 0) return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) return false;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing = sqRing;
+    } else {
+        cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+    }
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqeMap = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ringFd, IORING_OFF_SQES);
+    if (sqeMap == MAP_FAILED) return false;
+    sqes = static_cast<struct io_uring_sqe*>(sqeMap);
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Registering the buffer pins it once, instead of the kernel mapping
+    // user pages on every write
+    void* staging = ::mmap(nullptr, kStagingBufferSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (staging == MAP_FAILED) return false;
+    buffer = static_cast<char*>(staging);
+    struct iovec registered{buffer, kStagingBufferSize};
+    return ioUringRegister(ringFd, IORING_REGISTER_BUFFERS, &registered, 1) == 0;
+}
+
+IOUring::~IOUring() {
+    if (buffer) ::munmap(buffer, kStagingBufferSize);
+    if (sqes) ::munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED) ::munmap(sqRing, sqRingSize);
+    if (ringFd >= 0) ::close(ringFd);
+}
+
+IOUring* IOUring::forThisThread() {
+    thread_local std::unique_ptr<IOUring> ring = [] {
+        std::unique_ptr<IOUring> created(new IOUring());
+        if (!created->init()) {
+            std::cerr << "[WAL] io_uring setup failed on writer thread; using pwrite\n";
+            created.reset();
+        }
+        return created;
+    }();
+    return ring.get();
+}
+
+struct io_uring_sqe& IOUring::nextSqe() {
+    // Only this thread produces, so the tail can be read without ordering
+    unsigned index = (*sqTail + queued) & sqMask;
+    struct io_uring_sqe& sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqArray[index] = index;
+    ++queued;
+    return sqe;
+}
+
+IOUring::Result IOUring::write(int fd, uint64_t position, size_t length, bool sync) {
+    struct io_uring_sqe& write = nextSqe();
+    write.opcode = IORING_OP_WRITE_FIXED;
+    write.fd = fd;
+    write.off = position;
+    write.addr = reinterpret_cast<uint64_t>(buffer);
+    write.len = static_cast<uint32_t>(length);
+    write.buf_index = 0;
+    write.user_data = kWriteTag;
+    if (sync) {
+        // A short or failed write cancels the linked fdatasync
+        write.flags |= IOSQE_IO_LINK;
+        struct io_uring_sqe& fsync = nextSqe();
+        fsync.opcode = IORING_OP_FSYNC;
+        fsync.fd = fd;
+        fsync.fsync_flags = IORING_FSYNC_DATASYNC;
+        fsync.user_data = kSyncTag;
+    }
+    return submitAndWait();
+}
+
+IOUring::Result IOUring::sync(int fd) {
+    struct io_uring_sqe& fsync = nextSqe();
+    fsync.opcode = IORING_OP_FSYNC;
+    fsync.fd = fd;
+    fsync.fsync_flags = IORING_FSYNC_DATASYNC;
+    fsync.user_data = kSyncTag;
+    return submitAndWait();
+}
+
+IOUring::Result IOUring::submitAndWait() {
+    Result result;
+    unsigned expected = queued;
+    unsigned toSubmit = queued;
+    std::atomic_ref<unsigned>(*sqTail).store(*sqTail + queued, std::memory_order_release);
+    queued = 0;
+
+    unsigned reaped = 0;
+    while (reaped < expected) {
+        unsigned head = *cqHead;
+        if (head == std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire)) {
+            // Submit and wait for everything in one call; a signal can cut
+            // the wait short, in which case we simply wait again
+            int ret = ioUringEnter(ringFd, toSubmit, expected - reaped, IORING_ENTER_GETEVENTS);
+            ++result.enterCalls;
+            if (ret < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+                throw std::runtime_error(errnoMessage("io_uring_enter failed"));
+            }
+            toSubmit -= std::min(static_cast<unsigned>(ret), toSubmit);
+            continue;
+        }
+        const struct io_uring_cqe& cqe = cqes[head & cqMask];
+        if (cqe.user_data == kWriteTag) {
+            result.written = cqe.res;
+        } else {
+            result.synced = cqe.res;
+        }
+        std::atomic_ref<unsigned>(*cqHead).store(head + 1, std::memory_order_release);
+        ++reaped;
+    }
+    return result;
+}
+
+// Copies each commit into the writer thread's registered buffer and issues
+// it as one fixed-buffer write, with the fdatasync linked behind it so a
+// Sync commit costs a single io_uring_enter.
+class IOUringWALFile : public WALFile {
+    private:
+        void writeStaged(IOUring& ring, size_t length, bool sync);
+
+    public:
+        IOUringWALFile(int fd, uint64_t size) : WALFile(fd, size) {}
+        void write(struct iovec* iov, size_t count, bool sync) override;
+        void sync() override;
+        WALIOEngine engine() const override { return WALIOEngine::IOUring; }
+};
+
+void IOUringWALFile::write(struct iovec* iov, size_t count, bool sync) {
+    IOUring* ring = IOUring::forThisThread();
+    if (!ring) {
+        WALFile::write(iov, count, sync);
+        return;
+    }
+
+    // Batches larger than the staging buffer go out in buffer-sized pieces;
+    // only the last one carries the fdatasync
+    char* staging = ring->stagingBuffer();
+    size_t index = 0;
+    size_t copied = 0; // Bytes of iov[index] already staged
+    bool wrote = false;
+    while (index < count) {
+        size_t used = 0;
+        while (index < count && used < kStagingBufferSize) {
+            size_t n = std::min(iov[index].iov_len - copied, kStagingBufferSize - used);
+            std::memcpy(staging + used, static_cast<const char*>(iov[index].iov_base) + copied, n);
+            used += n;
+            copied += n;
+            if (copied == iov[index].iov_len) {
+                ++index;
+                copied = 0;
+            }
+        }
+        while (index < count && iov[index].iov_len == 0) ++index;
+        if (used == 0) break;
+        writeStaged(*ring, used, sync && index == count);
+        wrote = true;
+    }
+    if (sync && !wrote) this->sync();
+}
+
+void IOUringWALFile::writeStaged(IOUring& ring, size_t length, bool sync) {
+    auto result = ring.write(fd, offset, length, sync);
+    syscalls.fetch_add(result.enterCalls, std::memory_order_relaxed);
+    if (result.written < 0) {
+        throw std::runtime_error(errnoMessage("WAL write failed", -result.written));
+    }
+
+    bool needSync = sync && result.synced != 0;
+    if (static_cast<size_t>(result.written) < length) {
+        // Short write: finish it directly; the linked fdatasync was cancelled
+        struct iovec rest{ring.stagingBuffer() + result.written, length - result.written};
+        pwriteFully(&rest, 1, offset + result.written);
+    } else if (needSync && result.synced != -ECANCELED) {
+        throw std::runtime_error(errnoMessage("WAL fdatasync failed", -result.synced));
+    }
+    offset += length;
+    if (needSync) datasync();
+}
+
+void IOUringWALFile::sync() {
+    IOUring* ring = IOUring::forThisThread();
+    if (!ring) {
+        WALFile::sync();
+        return;
+    }
+    auto result = ring->sync(fd);
+    syscalls.fetch_add(result.enterCalls, std::memory_order_relaxed);
+    if (result.synced < 0) {
+        throw std::runtime_error(errnoMessage("WAL fdatasync failed", -result.synced));
+    }
+}
+
+} // namespace
+
+WALFile::WALFile(int fd, uint64_t size) : fd(fd), offset(size) {}
+
+WALFile::~WALFile() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+std::unique_ptr<WALFile> WALFile::open(const std::string& path, WALIOEngine engine) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open WAL file: " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error(errnoMessage("Failed to stat WAL file " + path, error));
+    }
+    auto size = static_cast<uint64_t>(st.st_size);
+
+    if (engine == WALIOEngine::IOUring) {
+        if (ioUringSupported()) {
+            return std::make_unique<IOUringWALFile>(fd, size);
+        }
+        std::cerr << "[WAL] io_uring unavailable; using pwrite for " << path << "\n";
+    }
+    return std::unique_ptr<WALFile>(new WALFile(fd, size));
+}
+
+void WALFile::pwriteFully(struct iovec* iov, size_t count, uint64_t position) {
+    while (count > 0) {
+        int chunk = static_cast<int>(std::min<size_t>(count, IOV_MAX));
+        ssize_t written = ::pwritev(fd, iov, chunk, static_cast<off_t>(position));
+        syscalls.fetch_add(1, std::memory_order_relaxed);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(errnoMessage("WAL write failed"));
+        }
+        position += static_cast<uint64_t>(written);
+        auto remaining = static_cast<size_t>(written);
+        while (count > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (remaining > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
+}
+
+void WALFile::datasync() {
+    syscalls.fetch_add(1, std::memory_order_relaxed);
+    if (::fdatasync(fd) != 0) {
+        throw std::runtime_error(errnoMessage("WAL fdatasync failed"));
+    }
+}
+
+void WALFile::write(struct iovec* iov, size_t count, bool sync) {
+    uint64_t length = 0;
+    for (size_t i = 0; i < count; ++i) length += iov[i].iov_len;
+    pwriteFully(iov, count, offset);
+    offset += length;
+    if (sync) datasync();
+}
+
+void WALFile::sync() {
+    datasync();
+}
+
+void WALFile::truncate(uint64_t size) {
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        throw std::runtime_error(errnoMessage("Failed to truncate WAL file"));
+    }
+    offset = size;
+}
+
+bool WALFile::allocate(uint64_t length) {
+    int rc;
+    do {
+        rc = ::fallocate(fd, 0, 0, static_cast<off_t>(length));
+    } while (rc != 0 && errno == EINTR);
+    return rc == 0;
+}
+
+void syncPath(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(errnoMessage("Failed to open " + path + " for fsync"));
+    }
+    int rc = ::fsync(fd);
+    int error = errno;
+    ::close(fd);
+    if (rc != 0) {
+        throw std::runtime_error(errnoMessage("fsync failed for " + path, error));
+    }
+}
+
+void syncParentDirectory(const std::string& path) {
+    auto parent = std::filesystem::path(path).parent_path();
+    syncPath(parent.empty() ? "." : parent.string());
+}
+
+std::vector<uint64_t> findNumberedFiles(const std::string& baseName, const std::string& tag,
+                                        size_t digits) {
+    namespace fs = std::filesystem;
+    fs::path base(baseName);
+    fs::path dir = base.parent_path().empty() ? fs::path(".") : base.parent_path();
+    std::string prefix = base.filename().string() + tag;
+
+    std::vector<uint64_t> numbers;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string number = name.substr(prefix.size());
+        if (number.size() > kMaxNumberDigits || (digits && number.size() != digits)) continue;
+        if (!std::all_of(number.begin(), number.end(), [](unsigned char c) { return std::isdigit(c); })) continue;
+        numbers.push_back(std::stoull(number));
+    }
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+// System call interface a WAL uses to write its file.
+enum class WALIOEngine : uint8_t {
+    PWrite,  // pwritev + fdatasync
+    IOUring, // io_uring with a registered staging buffer; PWrite if unavailable
+};
+
+// An open log file written at explicit offsets (never O_APPEND). Callers
+// serialize access. The base class issues pwritev and fdatasync directly;
+// open() returns an io_uring-backed file when asked for one and the kernel
+// supports it.
+class WALFile {
+    protected:
+        int fd;
+        uint64_t offset; // End of the log; the next write lands here
+        std::atomic<uint64_t> syscalls{0};
+
+        WALFile(int fd, uint64_t size);
+        void pwriteFully(struct iovec* iov, size_t count, uint64_t position);
+        void datasync();
+
+    public:
+        static std::unique_ptr<WALFile> open(const std::string& path, WALIOEngine engine);
+        WALFile(const WALFile&) = delete;
+        WALFile& operator=(const WALFile&) = delete;
+        virtual ~WALFile();
+
+        // Appends the buffers at the end of the log. With `sync` the data is
+        // durable when this returns. May modify `iov`.
+        virtual void write(struct iovec* iov, size_t count, bool sync);
+        virtual void sync();
+        void truncate(uint64_t size);
+        // Reserves disk blocks for the first `length` bytes so later writes
+        // don't grow the file. Returns false if the filesystem can't.
+        bool allocate(uint64_t length);
+        // Moves the end of the log, e.g. to the last intact record of a file
+        // whose tail was preallocated
+        void seek(uint64_t position) { offset = position; }
+
+        uint64_t size() const { return offset; }
+        virtual WALIOEngine engine() const { return WALIOEngine::PWrite; }
+        // Write/sync system calls issued so far, for comparing engines
+        uint64_t getSyscallCount() const { return syscalls.load(std::memory_order_relaxed); }
+};
+
+// fsync a file, or the directory holding it so a newly created or renamed
+// entry survives a crash.
+void syncPath(const std::string& path);
+void syncParentDirectory(const std::string& path);
+
+// Numbers n of the files named <baseName><tag><n> beside baseName, ascending.
+// With `digits` set, only names with exactly that many digits match.
+std::vector<uint64_t> findNumberedFiles(const std::string& baseName, const std::string& tag,
+                                        size_t digits = 0);
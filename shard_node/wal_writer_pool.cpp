@@ -0,0 +1,89 @@
+#include "wal_writer_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+WALWriterPool::WALWriterPool(size_t threadCount) {
+    threadCount = std::max<size_t>(threadCount, 1);
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (auto& worker : workers) {
+        worker->thread = std::thread(&WALWriterPool::workerLoop, this, std::ref(*worker));
+    }
+}
+
+WALWriterPool::~WALWriterPool() {
+    stopFlag = true;
+    for (auto& worker : workers) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->signaled = true;
+        }
+        worker->condition.notify_one();
+    }
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+size_t WALWriterPool::attach(WriteAheadLog* wal) {
+    size_t slot = nextWorker.fetch_add(1) % workers.size();
+    std::lock_guard<std::mutex> lock(workers[slot]->walsMutex);
+    workers[slot]->wals.push_back(wal);
+    return slot;
+}
+
+void WALWriterPool::detach(WriteAheadLog* wal, size_t slot) {
+    // Waits for a commit pass in progress, so the worker never sees `wal` again
+    std::lock_guard<std::mutex> lock(workers[slot]->walsMutex);
+    auto& wals = workers[slot]->wals;
+    wals.erase(std::remove(wals.begin(), wals.end(), wal), wals.end());
+}
+
+void WALWriterPool::wake(size_t slot) {
+    Worker& worker = *workers[slot];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.signaled = true;
+    }
+    worker.condition.notify_one();
+}
+
+bool WALWriterPool::hasWork(Worker& worker) {
+    std::lock_guard<std::mutex> lock(worker.walsMutex);
+    for (auto* wal : worker.wals) {
+        if (wal->hasWork()) return true;
+    }
+    return false;
+}
+
+void WALWriterPool::workerLoop(Worker& worker) {
+    while (!stopFlag) {
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.state.sleeping.store(true, std::memory_order_relaxed);
+            worker.state.parked.store(true, std::memory_order_seq_cst);
+            if (!worker.signaled && !hasWork(worker)) {
+                worker.condition.wait(lock, [&] { return worker.signaled || stopFlag.load(); });
+                worker.signaled = false;
+            }
+            worker.state.parked.store(false, std::memory_order_seq_cst);
+
+            // Give the logs a batch window unless a producer or waiter asked
+            // for an immediate commit
+            worker.condition.wait_for(lock, std::chrono::milliseconds(WriteAheadLog::BATCH_TIMEOUT_MS),
+                [&] { return worker.signaled || stopFlag.load(); });
+            worker.signaled = false;
+            worker.state.sleeping.store(false, std::memory_order_relaxed);
+        }
+        wakeups.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(worker.walsMutex);
+        for (auto* wal : worker.wals) {
+            wal->commitPending();
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "wal.hpp"
+
+// A small set of writer threads shared by many WriteAheadLogs. Each log is
+// pinned to one worker (round-robin at attach time) which drains it with the
+// same group-commit logic as a dedicated writer thread. A worker parks with
+// no timeout while none of its logs has anything queued, so idle partitions
+// cost no wakeups at all.
+class WALWriterPool {
+    private:
+        struct Worker {
+            std::thread thread;
+            std::mutex mutex;               // Guards `signaled`
+            std::condition_variable condition;
+            bool signaled = false;
+            WALWriterState state;
+            std::mutex walsMutex;           // Guards `wals`; held while committing
+            std::vector<WriteAheadLog*> wals;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<size_t> nextWorker{0};
+        std::atomic<bool> stopFlag{false};
+        std::atomic<uint64_t> wakeups{0};
+
+        void workerLoop(Worker& worker);
+        bool hasWork(Worker& worker);
+
+    public:
+        static constexpr size_t DEFAULT_THREADS = 4;
+
+        explicit WALWriterPool(size_t threadCount = DEFAULT_THREADS);
+        ~WALWriterPool();
+
+        // Called by WriteAheadLog; attach returns the worker slot for the log.
+        size_t attach(WriteAheadLog* wal);
+        void detach(WriteAheadLog* wal, size_t slot);
+        void wake(size_t slot);
+        WALWriterState& writerState(size_t slot) { return workers[slot]->state; }
+
+        size_t getThreadCount() const { return workers.size(); }
+        // Number of times a worker woke up, for comparing against per-log threads
+        uint64_t getWakeupCount() const { return wakeups.load(); }
+};
@@ -0,0 +1,30 @@
+#include "../../shard_node/coarse_clock.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+// The cached time trails the real clock by no more than about a tick, and
+// keeps moving
+TEST(CoarseClockTest, TracksSteadyClock) {
+    auto before = CoarseClock::Clock::now();
+    auto first = CoarseClock::now();
+    EXPECT_GE(first + CoarseClock::getResolution() + 50ms, before);
+    EXPECT_LE(first, CoarseClock::Clock::now());
+
+    std::this_thread::sleep_for(20ms);
+    auto second = CoarseClock::now();
+    EXPECT_GE(second - first, 10ms);
+    EXPECT_LE(second, CoarseClock::Clock::now());
+}
+
+TEST(CoarseClockTest, ResolutionIsAdjustable) {
+    CoarseClock::setResolution(20ms);
+    EXPECT_EQ(CoarseClock::getResolution(), 20ms);
+    std::this_thread::sleep_for(30ms);
+    auto lag = CoarseClock::Clock::now() - CoarseClock::now();
+    EXPECT_LE(lag, 20ms + 50ms);
+
+    CoarseClock::setResolution(CoarseClock::DEFAULT_RESOLUTION);
+    EXPECT_EQ(CoarseClock::getResolution(), CoarseClock::DEFAULT_RESOLUTION);
+}
@@ -0,0 +1,80 @@
+#include "../../shard_node/entry_table.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+TEST(EntryTableTest, InsertFindErase) {
+    EntryTable table;
+    EXPECT_EQ(table.find("missing"), table.end());
+    EXPECT_EQ(table.begin(), table.end());
+
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(table.insert(Entry("key_" + std::to_string(i), std::to_string(i))).second);
+    }
+    EXPECT_EQ(table.size(), 1000u);
+
+    // A duplicate key is refused and the entry handed back untouched
+    Entry duplicate("key_7", "other");
+    auto [it, inserted] = table.insert(std::move(duplicate));
+    EXPECT_FALSE(inserted);
+    EXPECT_EQ(it->getValue(), "7");
+    EXPECT_EQ(duplicate.getValue(), "other");
+
+    for (int i = 0; i < 1000; i += 2) {
+        table.erase(table.find("key_" + std::to_string(i)));
+    }
+    EXPECT_EQ(table.size(), 500u);
+    for (int i = 0; i < 1000; ++i) {
+        auto found = table.find("key_" + std::to_string(i));
+        if (i % 2) {
+            ASSERT_NE(found, table.end());
+            EXPECT_EQ(found->getValue(), std::to_string(i));
+        } else {
+            EXPECT_EQ(found, table.end());
+        }
+    }
+
+    size_t iterated = 0;
+    for (const auto& entry : table) {
+        EXPECT_EQ(entry.getKey().substr(0, 4), "key_");
+        ++iterated;
+    }
+    EXPECT_EQ(iterated, 500u);
+
+    // Every entry sits in exactly one one-slot bucket
+    size_t inBuckets = 0;
+    for (size_t b = 0; b < table.bucket_count(); ++b) {
+        for (auto e = table.begin(b); e != table.end(b); ++e) ++inBuckets;
+    }
+    EXPECT_EQ(inBuckets, 500u);
+}
+
+// Random churn with lots of tombstones, checked against std::unordered_map
+TEST(EntryTableTest, MatchesUnorderedMapUnderChurn) {
+    EntryTable table;
+    std::unordered_map<std::string, std::string> reference;
+    std::mt19937 random(42);
+    for (int op = 0; op < 200000; ++op) {
+        std::string key = "k" + std::to_string(random() % 5000);
+        if (random() % 3 == 0) {
+            auto it = table.find(key);
+            EXPECT_EQ(it != table.end(), reference.erase(key) == 1);
+            if (it != table.end()) table.erase(it);
+        } else {
+            std::string value = std::to_string(op);
+            auto [it, inserted] = table.insert(Entry(key, value));
+            EXPECT_EQ(inserted, reference.emplace(key, value).second);
+        }
+    }
+    ASSERT_EQ(table.size(), reference.size());
+    for (const auto& [key, value] : reference) {
+        auto it = table.find(key);
+        ASSERT_NE(it, table.end());
+        EXPECT_EQ(it->getValue(), value);
+    }
+
+    table.reserve(100000);
+    EXPECT_EQ(table.size(), reference.size());
+    EXPECT_NE(table.find(reference.begin()->first), table.end());
+}
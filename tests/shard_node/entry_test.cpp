@@ -0,0 +1,110 @@
+#include "../../shard_node/entry.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <unordered_set>
+
+using namespace std::chrono_literals;
+
+TEST(EntryTest, HoldsKeyValueAndDeadline) {
+    Entry plain("key", "value");
+    EXPECT_EQ(plain.getKey(), "key");
+    EXPECT_EQ(plain.getValue(), "value");
+    EXPECT_FALSE(plain.hasExpiration());
+    EXPECT_FALSE(plain.isExpired(Entry::Clock::now() + 24h));
+
+    // Lengths past a byte, arbitrary bytes, and an empty value
+    std::string longKey(300, 'k');
+    std::string binary("a\0b\tc\n", 6);
+    Entry large(longKey, binary);
+    EXPECT_EQ(large.getKey(), longKey);
+    EXPECT_EQ(large.getValue(), binary);
+    Entry empty("k", "");
+    EXPECT_EQ(empty.getValue(), "");
+
+    // Deadlines are kept to the ms, never earlier than asked for
+    auto deadline = Entry::Clock::now() + 1500us;
+    Entry ttl("key", "value", deadline);
+    ASSERT_TRUE(ttl.getExpiration().has_value());
+    EXPECT_GE(*ttl.getExpiration(), deadline);
+    EXPECT_LT(*ttl.getExpiration(), deadline + 1ms);
+    EXPECT_FALSE(ttl.isExpired(deadline - 1ms));
+    EXPECT_TRUE(ttl.isExpired(*ttl.getExpiration()));
+
+    // Past the 32-bit range, and before the epoch
+    auto far = Entry::EPOCH + std::chrono::hours(24 * 365);
+    EXPECT_EQ(Entry("key", "value", far).getExpiration(), far);
+    EXPECT_TRUE(Entry("key", "value", Entry::EPOCH - 1s).isExpired(Entry::Clock::now()));
+
+    Entry moved(std::move(ttl));
+    EXPECT_EQ(moved.getKey(), "key");
+}
+
+TEST(EntryTest, SetFindsEntriesByKey) {
+    std::unordered_set<Entry, EntryHash, EntryKeyEqual> set;
+    set.insert(Entry("a", "1"));
+    set.insert(Entry("b", "2"));
+    EXPECT_FALSE(set.insert(Entry("a", "3")).second);
+
+    auto it = set.find(std::string_view("a"));
+    ASSERT_NE(it, set.end());
+    EXPECT_EQ(it->getValue(), "1");
+    EXPECT_EQ(set.find(std::string_view("c")), set.end());
+}
+
+// However the key arrives, it hashes the same as the entry that holds it
+TEST(EntryTest, HashedKeyMatchesEntryHash) {
+    std::string key = "some_key";
+    Entry entry(key, "value");
+    EXPECT_EQ(HashedKey(key).hash, EntryHash{}(entry));
+    EXPECT_EQ(HashedKey("some_key").hash, EntryHash{}(entry));
+    EXPECT_EQ(HashedKey(std::string_view("some_key_suffix").substr(0, 8)).hash, EntryHash{}(entry));
+}
+
+// A value handed over as an rvalue string is kept in its own buffer, and an
+// entry built from it holds a reference rather than a copy
+TEST(EntryTest, SharedValue) {
+    std::string bytes(8192, 's');
+    const char* data = bytes.data();
+    SharedValue shared = PutValue(std::move(bytes)).share();
+    EXPECT_EQ(shared.view().data(), data);
+
+    auto deadline = Entry::Clock::now() + std::chrono::hours(1);
+    {
+        Entry entry("key", shared, deadline);
+        EXPECT_EQ(entry.getKey(), "key");
+        EXPECT_EQ(entry.getValue().data(), data);
+        EXPECT_EQ(entry.getValue().size(), 8192u);
+        EXPECT_TRUE(entry.hasExpiration());
+        EXPECT_FALSE(entry.isExpired(Entry::Clock::now()));
+
+        Entry moved = std::move(entry);
+        EXPECT_EQ(moved.getValue().data(), data);
+    }
+    // The entry's reference is gone; ours still reads
+    EXPECT_EQ(shared.view(), std::string(8192, 's'));
+}
+
+// The access word sits in front of the block and survives copies into a
+// slab and back out
+TEST(EntryTest, AccessWord) {
+    Entry plain("key", "value");
+    EXPECT_FALSE(plain.isTracked());
+
+    Entry entry("key", "value", std::nullopt, nullptr, 7u);
+    EXPECT_TRUE(entry.isTracked());
+    EXPECT_EQ(entry.getAccess(), 7u);
+    EXPECT_EQ(entry.blockSize(), plain.blockSize() + sizeof(uint32_t));
+    entry.setAccess(42);
+    EXPECT_EQ(entry.getKey(), "key");
+    EXPECT_EQ(entry.getValue(), "value");
+
+    auto slabs = SlabAllocator::create();
+    Entry pooled = Entry::copy(entry, slabs.get());
+    EXPECT_EQ(pooled.getAccess(), 42u);
+    EXPECT_EQ(pooled.getValue(), "value");
+    EXPECT_EQ(slabs->getBytesUsed(), pooled.blockSize());
+    Entry back = Entry::copy(pooled, nullptr);
+    EXPECT_EQ(back.getAccess(), 42u);
+    pooled = Entry();
+    EXPECT_EQ(slabs->getBytesUsed(), 0u);
+}
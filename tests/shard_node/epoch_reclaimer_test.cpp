@@ -0,0 +1,51 @@
+#include "../../shard_node/epoch_reclaimer.hpp"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+std::atomic<int> freed{0};
+
+void countFree(void* p) {
+    delete static_cast<int*>(p);
+    ++freed;
+}
+
+} // namespace
+
+TEST(EpochReclaimerTest, FreesOnceNoReaderIsPinned) {
+    freed = 0;
+    EpochReclaimer::retire(new int(1), &countFree, sizeof(int));
+    EpochReclaimer::reclaim();
+    EXPECT_EQ(freed, 1);
+}
+
+// A reader pinned before the retire holds the memory back until it leaves
+TEST(EpochReclaimerTest, PinnedReaderDelaysFree) {
+    freed = 0;
+    std::atomic<bool> pinned{false}, release{false};
+    std::thread reader([&] {
+        EpochReclaimer::Guard guard;
+        pinned = true;
+        while (!release) std::this_thread::yield();
+    });
+    while (!pinned) std::this_thread::yield();
+
+    EpochReclaimer::retire(new int(2), &countFree, sizeof(int));
+    for (int i = 0; i < 10; ++i) EpochReclaimer::reclaim();
+    EXPECT_EQ(freed, 0);
+
+    release = true;
+    reader.join();
+    EpochReclaimer::reclaim();
+    EXPECT_EQ(freed, 1);
+}
+
+// Memory retired by a thread that exits is freed by whoever reclaims next
+TEST(EpochReclaimerTest, ExitedThreadsHandOver) {
+    freed = 0;
+    std::thread([] { EpochReclaimer::retire(new int(3), &countFree, sizeof(int)); }).join();
+    EpochReclaimer::reclaim();
+    EXPECT_EQ(freed, 1);
+}
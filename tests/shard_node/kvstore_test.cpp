@@ -1,5 +1,57 @@
 #include "../../shard_node/kvstore.hpp"
+#include "../../shard_node/wal.hpp"
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+
+namespace {
+
+// Every file a store keeps beside its log: segments, spares, snapshot, deltas
+std::vector<std::string> storeFiles(const std::string& log) {
+    std::vector<std::string> files;
+    for (const auto& entry : std::filesystem::directory_iterator(".")) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind(log + ".", 0) == 0) files.push_back(name);
+    }
+    return files;
+}
+
+void removeStore(const std::string& log) {
+    for (const auto& file : storeFiles(log)) {
+        std::filesystem::remove(file);
+    }
+}
+
+// Copies a store's files as a crash would leave them
+void copyStore(const std::string& log, const std::string& copy) {
+    for (const auto& file : storeFiles(log)) {
+        std::filesystem::copy_file(file, copy + file.substr(log.size()));
+    }
+}
+
+size_t deltaCount(const std::string& log) {
+    size_t count = 0;
+    for (const auto& file : storeFiles(log)) {
+        if (file.find(".delta.") != std::string::npos) ++count;
+    }
+    return count;
+}
+
+// JSON records of about `bytes`, compressible as real documents are
+std::string jsonValue(size_t bytes, int seed) {
+    std::string value = "[";
+    for (int i = 0; value.size() < bytes; ++i) {
+        int id = seed * 100000 + i;
+        value += "{\"id\":" + std::to_string(id) + ",\"name\":\"user_" + std::to_string(id * 7 % 1000) +
+                 "\",\"active\":" + (id % 3 ? "true" : "false") + ",\"score\":" + std::to_string(id % 97) + "},";
+    }
+    value.back() = ']';
+    return value;
+}
+
+} // namespace
 
 TEST(KVStoreTest, BasicPutGet) {
     auto store = KVStore::create("test_wal.log");
@@ -55,4 +107,667 @@ TEST(KVStoreTest, ConcurrentPut) {
     // Should not crash, value should be A or B (last writer wins)
     auto value = store->get("key");
     EXPECT_TRUE(value.has_value());
-}
\ No newline at end of file
+}
+
+// Large values, moved in or copied, with and without a TTL, come back the
+// same from memory and from the WAL
+TEST(KVStoreTest, LargeValuesSurviveRestart) {
+    const std::string log = "test_large_values.log";
+    removeStore(log);
+    std::string big(64 * 1024, 'b');
+    std::string ttl(5000, 't');
+    {
+        KVStoreOptions options;
+        options.backgroundThreads = false;
+        auto store = KVStore::create(log, options);
+        store->put("moved", std::string(big));
+        store->put("copied", big, Durability::Sync);
+        store->put("ttl", std::string(ttl), 3600 * 1000, Durability::Sync);
+        EXPECT_EQ(store->get("moved"), big);
+        EXPECT_EQ(store->get("ttl"), ttl);
+        store->put("moved", "small now");
+    }
+    {
+        auto store = KVStore::create(log);
+        EXPECT_EQ(store->get("moved"), "small now");
+        EXPECT_EQ(store->get("copied"), big);
+        EXPECT_EQ(store->get("ttl"), ttl);
+    }
+    removeStore(log);
+}
+
+// Bytes used follow the entries exactly; removing most of them and running
+// cleanup compacts the rest into fewer slabs
+TEST(KVStoreTest, MemoryAccountingAndCompaction) {
+    const std::string log = "test_memory.log";
+    removeStore(log);
+    {
+        KVStoreOptions options;
+        options.backgroundThreads = false;
+        options.deltaSnapshotsPerFull = 0;
+        auto store = KVStore::create(log, options);
+        EXPECT_EQ(store->getMemoryStats().bytesUsed, 0u);
+
+        // 10-byte keys and values: a 1 byte flags, 2 byte lengths block
+        const size_t keys = 50000;
+        auto keyOf = [](size_t i) { return "k" + std::string(9 - std::to_string(i).size(), '0') + std::to_string(i); };
+        for (size_t i = 0; i < keys; ++i) store->put(keyOf(i), "0123456789");
+        std::string big(8192, 'b');
+        store->put("big", std::string(big));
+        EXPECT_EQ(store->getMemoryStats().bytesUsed, keys * 23 + (1 + 8 + 3 + sizeof(void*)) + big.size());
+
+        for (size_t i = 0; i < keys; ++i) {
+            if (i % 20 != 0) store->remove(keyOf(i));
+        }
+        store->remove("big");
+        auto before = store->getMemoryStats();
+        EXPECT_EQ(before.bytesUsed, keys / 20 * 23);
+        EXPECT_GT(before.fragmentation, 0.9);
+
+        store->runCleanup();
+        auto after = store->getMemoryStats();
+        EXPECT_EQ(after.compactions, 1u);
+        EXPECT_GT(after.entriesMoved, 0u);
+        EXPECT_LT(after.slabBytes, before.slabBytes);
+        EXPECT_EQ(after.bytesUsed, before.bytesUsed);
+        for (size_t i = 0; i < keys; i += 20) ASSERT_EQ(store->get(keyOf(i)), "0123456789");
+    }
+    removeStore(log);
+}
+
+namespace {
+
+// Fills a store well past its memory limit with keys nobody reads, while
+// `hot` keys keep being read; returns how many of those survive
+size_t fillPastLimit(KVStore& store, const std::vector<std::string>& hot, size_t limit) {
+    for (const auto& key : hot) store.put(key, std::string(50, 'h'));
+    for (int chunk = 0; chunk < 40; ++chunk) {
+        for (int i = 0; i < 500; ++i) {
+            store.put("cold_" + std::to_string(chunk * 500 + i), std::string(50, 'c'));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        for (const auto& key : hot) store.get(key);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        EXPECT_LE(store.getMemoryStats().bytesUsed, limit);
+    }
+    size_t survived = 0;
+    for (const auto& key : hot) survived += store.get(key).has_value();
+    return survived;
+}
+
+} // namespace
+
+TEST(KVStoreTest, EvictsUnderMemoryLimit) {
+    std::vector<std::string> hot;
+    for (int i = 0; i < 100; ++i) hot.push_back("hot_" + std::to_string(i));
+    for (EvictionPolicy policy : {EvictionPolicy::LRU, EvictionPolicy::LFU}) {
+        const std::string log = "test_eviction.log";
+        removeStore(log);
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.maxMemoryBytes = 256 * 1024;
+            options.evictionPolicy = policy;
+            auto store = KVStore::create(log, options);
+            EXPECT_GE(fillPastLimit(*store, hot, options.maxMemoryBytes), 95u);
+            auto stats = store->getMemoryStats();
+            EXPECT_GT(stats.keysEvicted, 15000u);
+            EXPECT_GT(stats.bytesEvicted, stats.keysEvicted * 60);
+            EXPECT_EQ(stats.evictionMisses, 0u);
+        }
+        // Evictions were logged, so the store comes back under its limit
+        {
+            KVStoreOptions options;
+            options.backgroundThreads = false;
+            options.maxMemoryBytes = 256 * 1024;
+            options.evictionPolicy = policy;
+            auto store = KVStore::create(log, options);
+            EXPECT_LE(store->getMemoryStats().bytesUsed, options.maxMemoryBytes);
+            EXPECT_EQ(store->getMemoryStats().keysEvicted, 0u);
+        }
+        removeStore(log);
+    }
+}
+
+// Only keys with a TTL are evicted, soonest deadline first
+TEST(KVStoreTest, EvictsVolatileKeysFirst) {
+    const std::string log = "test_eviction_ttl.log";
+    removeStore(log);
+    {
+        KVStoreOptions options;
+        options.backgroundThreads = false;
+        options.maxMemoryBytes = 128 * 1024;
+        options.evictionPolicy = EvictionPolicy::VolatileTTL;
+        auto store = KVStore::create(log, options);
+        for (int i = 0; i < 500; ++i) store->put("persistent_" + std::to_string(i), std::string(50, 'p'));
+        for (int i = 0; i < 5000; ++i) {
+            store->put("volatile_" + std::to_string(i), std::string(50, 'v'), 3600 * 1000 + i * 10);
+        }
+        for (int i = 0; i < 500; ++i) ASSERT_TRUE(store->get("persistent_" + std::to_string(i)).has_value());
+        EXPECT_TRUE(store->get("volatile_4999").has_value());
+        auto stats = store->getMemoryStats();
+        EXPECT_GT(stats.expiryIndexBytes, 0u);
+        EXPECT_LE(stats.bytesUsed + stats.expiryIndexBytes, options.maxMemoryBytes);
+        EXPECT_GT(stats.keysEvicted, 0u);
+
+        // Nothing left that the policy may evict
+        for (int i = 500; i < 3000; ++i) store->put("persistent_" + std::to_string(i), std::string(50, 'p'));
+        EXPECT_GT(store->getMemoryStats().evictionMisses, 0u);
+    }
+    removeStore(log);
+}
+
+// A key rewritten with a TTL keeps one wheel entry, dropped with the key or
+// its TTL
+TEST(KVStoreTest, HotTTLKeyKeepsOneWheelEntry) {
+    const std::string log = "test_ttl_index.log";
+    removeStore(log);
+    {
+        KVStoreOptions options;
+        options.backgroundThreads = false;
+        auto store = KVStore::create(log, options);
+        store->put("hot", "0", 60 * 1000);
+        size_t bytes = store->getMemoryStats().expiryIndexBytes;
+        EXPECT_GT(bytes, 0u);
+        for (int i = 1; i < 10000; ++i) store->put("hot", std::to_string(i), 60 * 1000 + i);
+        EXPECT_EQ(store->getMemoryStats().expiryIndexBytes, bytes);
+
+        store->put("hot", "persistent");
+        store->put("other", "1", 60 * 1000);
+        store->remove("other");
+        store->runCleanup();
+        EXPECT_EQ(store->get("hot"), "persistent");
+        EXPECT_LT(store->getMemoryStats().expiryIndexBytes, bytes);
+    }
+    removeStore(log);
+}
+
+// Large values stay compressed in memory, the WAL and snapshots, and come
+// back whole from each
+TEST(KVStoreTest, CompressesLargeValues) {
+    const std::string log = "test_compression.log";
+    std::string small = jsonValue(200, 1);
+    std::string medium = jsonValue(8 << 10, 2);
+    std::string large = jsonValue(256 << 10, 3); // Kept in a shared buffer even compressed
+    std::string noise(4096, '\0');
+    std::mt19937 random(7);
+    for (char& c : noise) c = static_cast<char>(random());
+
+    for (ValueCompression codec : {ValueCompression::LZ4, ValueCompression::Zstd}) {
+        SCOPED_TRACE(ValueCodec::name(codec));
+        removeStore(log);
+        KVStoreOptions options;
+        options.backgroundThreads = false;
+        options.valueCompression = codec;
+        if (!ValueCodec::isAvailable(codec)) {
+            EXPECT_THROW(KVStore::create(log, options), std::runtime_error);
+            continue;
+        }
+        {
+            auto store = KVStore::create(log, options);
+            store->put("small", small);
+            store->put("medium", medium);
+            store->put("ttl", medium, 3600 * 1000);
+            store->put("large", std::string(large));
+            store->put("noise", noise);
+            store->runSnapshot();
+            store->put("after", large); // Only in the WAL
+
+            EXPECT_EQ(store->get("small"), small);
+            EXPECT_EQ(store->get("medium"), medium);
+            EXPECT_EQ(store->get("ttl"), medium);
+            EXPECT_EQ(store->get("large"), large);
+            EXPECT_EQ(store->get("noise"), noise);
+            EXPECT_EQ(store->get("after"), large);
+
+            auto stats = store->getCompressionStats();
+            EXPECT_EQ(stats.valuesCompressed, 4u);
+            EXPECT_EQ(stats.valuesIncompressible, 1u);
+            EXPECT_EQ(stats.rawBytes, 2 * medium.size() + 2 * large.size());
+            EXPECT_GT(stats.ratio, 2.0);
+            EXPECT_LT(store->getMemoryStats().bytesUsed, stats.rawBytes / 2);
+        }
+        // A store that doesn't compress still reads them
+        options.valueCompression = ValueCompression::None;
+        {
+            auto store = KVStore::create(log, options);
+            EXPECT_EQ(store->get("small"), small);
+            EXPECT_EQ(store->get("ttl"), medium);
+            EXPECT_EQ(store->get("large"), large);
+            EXPECT_EQ(store->get("noise"), noise);
+            EXPECT_EQ(store->get("after"), large);
+            EXPECT_EQ(store->getCompressionStats().valuesCompressed, 0u);
+        }
+        removeStore(log);
+    }
+}
+
+// Snapshot blocks are written compressed where that helps, and read back
+// by the codec their file names, whatever the reading store's setting
+TEST(KVStoreTest, CompressesSnapshotBlocks) {
+    const std::string log = "test_snapshot_compression.log";
+    const int keys = 20000; // A few blocks' worth
+    std::string noise(4096, '\0');
+    std::mt19937 random(11);
+    for (char& c : noise) c = static_cast<char>(random());
+
+    size_t plainBytes = 0;
+    for (ValueCompression codec : {ValueCompression::None, ValueCompression::LZ4, ValueCompression::Zstd}) {
+        SCOPED_TRACE(ValueCodec::name(codec));
+        removeStore(log);
+        KVStoreOptions options;
+        options.backgroundThreads = false;
+        options.deltaSnapshotsPerFull = 0;
+        options.snapshotCompression = codec;
+        if (!ValueCodec::isAvailable(codec)) {
+            EXPECT_THROW(KVStore::create(log, options), std::runtime_error);
+            continue;
+        }
+        {
+            auto store = KVStore::create(log, options);
+            for (int i = 0; i < keys; ++i) store->put("key_" + std::to_string(i), jsonValue(150, i));
+            store->put("noise", noise, 3600 * 1000);
+            store->runSnapshot();
+        }
+        size_t bytes = std::filesystem::file_size(log + ".snapshot");
+        if (codec == ValueCompression::None) {
+            plainBytes = bytes;
+        } else {
+            EXPECT_LT(bytes, plainBytes / 2);
+        }
+
+        options.snapshotCompression = ValueCompression::None;
+        {
+            auto store = KVStore::create(log, options);
+            EXPECT_EQ(store->getRecoveryStats().snapshotEntries, static_cast<size_t>(keys) + 1);
+            EXPECT_EQ(store->getRecoveryStats().walRecords, 0u);
+            for (int i = 0; i < keys; i += 97) ASSERT_EQ(store->get("key_" + std::to_string(i)), jsonValue(150, i));
+            EXPECT_EQ(store->get("key_" + std::to_string(keys - 1)), jsonValue(150, keys - 1));
+            EXPECT_EQ(store->get("noise"), noise);
+        }
+        removeStore(log);
+    }
+}
+
+TEST(KVStoreTest, SyncPutIsLoggedBeforeReturn) {
+    WriteAheadLog::removeLog("test_sync_wal.log");
+    auto store = KVStore::create("test_sync_wal.log");
+    store->put("durable", "value", Durability::Sync);
+
+    // The record is already on disk without any flush or shutdown
+    bool found = false;
+    WriteAheadLog::replay("test_sync_wal.log", [&found](const WALRecord& record) {
+        found = found || record.key == "durable";
+    });
+    EXPECT_TRUE(found);
+}
+
+// A snapshot retires the segments it covers; writes after it are recovered
+// from the remaining segments on top of the snapshot
+TEST(KVStoreTest, SnapshotRetiresCoveredSegments) {
+    const std::string log = "test_checkpoint_wal.log";
+    const std::string crashed = "test_checkpoint_crashed.log";
+    removeStore(log);
+    removeStore(crashed);
+
+    KVStoreOptions options;
+    options.backgroundThreads = false;
+    options.wal.segmentSize = 512;
+    {
+        auto store = KVStore::create(log, options);
+        for (int i = 0; i < 100; ++i) {
+            store->put("key" + std::to_string(i), "before");
+        }
+        store->runSnapshot();
+        EXPECT_LE(WriteAheadLog::listSegments(log).size(), 2);
+
+        for (int i = 50; i < 150; ++i) {
+            store->put("key" + std::to_string(i), "after", Durability::Sync);
+        }
+        store->remove("key0", Durability::Sync);
+
+        // Copy the files before shutdown writes another snapshot
+        copyStore(log, crashed);
+    }
+
+    auto recovered = KVStore::create(crashed, options);
+    EXPECT_FALSE(recovered->get("key0").has_value());
+    EXPECT_EQ(recovered->get("key1"), "before");
+    EXPECT_EQ(recovered->get("key50"), "after");
+    EXPECT_EQ(recovered->get("key149"), "after");
+    recovered.reset();
+
+    removeStore(log);
+    removeStore(crashed);
+}
+
+// A snapshot that can't be put in place fails, and the log it would have
+// covered stays whole
+TEST(KVStoreTest, FailedSnapshotRenameKeepsSegments) {
+    const std::string log = "test_snapshot_rename.log";
+    const std::string crashed = "test_snapshot_rename_crashed.log";
+    removeStore(log);
+    removeStore(crashed);
+
+    KVStoreOptions options;
+    options.backgroundThreads = false;
+    options.wal.segmentSize = 512;
+    {
+        auto store = KVStore::create(log, options);
+        for (int i = 0; i < 100; ++i) store->put("key" + std::to_string(i), "value", Durability::Sync);
+        auto segments = WriteAheadLog::listSegments(log);
+        ASSERT_GT(segments.size(), 2u);
+
+        // rename() can't replace a directory with a file
+        std::filesystem::create_directory(log + ".snapshot");
+        EXPECT_THROW(store->runSnapshot(), std::runtime_error);
+        EXPECT_EQ(WriteAheadLog::listSegments(log), segments);
+        EXPECT_TRUE(std::filesystem::exists(log + ".snapshot.tmp"));
+        std::filesystem::remove(log + ".snapshot");
+        copyStore(log, crashed);
+    }
+
+    auto recovered = KVStore::create(crashed, options);
+    for (int i = 0; i < 100; ++i) ASSERT_EQ(recovered->get("key" + std::to_string(i)), "value");
+    recovered.reset();
+
+    removeStore(log);
+    removeStore(crashed);
+}
+
+// The binary snapshot keeps keys and values byte for byte, including the
+// whitespace the old text format split on
+TEST(KVStoreTest, SnapshotPreservesArbitraryBytes) {
+    const std::string log = "test_binary_snapshot.log";
+    WriteAheadLog::removeLog(log);
+    std::filesystem::remove(log + ".snapshot");
+
+    const std::string key = "key with\tspaces";
+    const std::string value = std::string("line one\nline two\t") + '\0' + "end";
+    KVStoreOptions options;
+    options.backgroundThreads = false;
+    {
+        auto store = KVStore::create(log, options);
+        store->put(key, value);
+        store->put("ttl", "soon", 60000);
+    }
+
+    auto store = KVStore::create(log, options);
+    EXPECT_EQ(store->getRecoveryStats().snapshotEntries, 2u);
+    EXPECT_EQ(store->getRecoveryStats().walRecords, 0u);
+    EXPECT_EQ(store->get(key), value);
+    EXPECT_EQ(store->get("ttl"), "soon");
+    store.reset();
+
+    // A damaged snapshot is refused rather than loaded partially
+    {
+        std::fstream file(log + ".snapshot", std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put('X');
+    }
+    EXPECT_THROW(KVStore::create(log, options), std::runtime_error);
+
+    WriteAheadLog::removeLog(log);
+    std::filesystem::remove(log + ".snapshot");
+}
+
+// Snapshots written in the old text format still load after an upgrade
+TEST(KVStoreTest, LoadsTextSnapshot) {
+    const std::string log = "test_text_snapshot.log";
+    WriteAheadLog::removeLog(log);
+    {
+        std::ofstream out(log + ".snapshot");
+        out << "KVSNAP\t0\t2\nalpha\t1\t-1\nbeta\t2\t-1\n";
+    }
+
+    auto store = KVStore::create(log);
+    EXPECT_EQ(store->get("alpha"), "1");
+    EXPECT_EQ(store->get("beta"), "2");
+    store.reset();
+
+    WriteAheadLog::removeLog(log);
+    std::filesystem::remove(log + ".snapshot");
+}
+
+// Snapshots taken while writers run don't stop them; the image plus the
+// records after the snapshot's LSN recover exactly the final state
+TEST(KVStoreTest, SnapshotDuringConcurrentWrites) {
+    const std::string log = "test_fuzzy_snapshot.log";
+    const std::string crashed = "test_fuzzy_crashed.log";
+    removeStore(log);
+    removeStore(crashed);
+
+    const int threads = 4;
+    const int writes = 2000;
+    auto keyFor = [](int t, int i) { return "t" + std::to_string(t) + "_" + std::to_string(i % 50); };
+    KVStoreOptions options;
+    options.backgroundThreads = false;
+    options.wal.segmentSize = 4096;
+    {
+        auto store = KVStore::create(log, options);
+        std::atomic<int> running{threads};
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t) {
+            writers.emplace_back([&, t] {
+                for (int i = 0; i < writes; ++i) {
+                    if (i % 7 == 3) {
+                        store->remove(keyFor(t, i), Durability::Sync);
+                    } else {
+                        store->put(keyFor(t, i), std::to_string(i), Durability::Sync);
+                    }
+                }
+                running--;
+            });
+        }
+        while (running > 0) {
+            store->runSnapshot();
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        copyStore(log, crashed);
+    }
+
+    auto recovered = KVStore::create(crashed, options);
+    for (int t = 0; t < threads; ++t) {
+        for (int i = writes - 50; i < writes; ++i) {
+            auto value = recovered->get(keyFor(t, i));
+            if (i % 7 == 3) {
+                EXPECT_FALSE(value.has_value()) << keyFor(t, i);
+            } else {
+                EXPECT_EQ(value, std::to_string(i)) << keyFor(t, i);
+            }
+        }
+    }
+    recovered.reset();
+
+    removeStore(log);
+    removeStore(crashed);
+}
+
+// Snapshots after the first write only the keys changed since the previous
+// one; recovery applies the chain, and the chain is folded back into a full
+// snapshot after deltaSnapshotsPerFull deltas
+TEST(KVStoreTest, DeltaSnapshotChain) {
+    const std::string log = "test_delta_snapshot.log";
+    const std::string crashed = "test_delta_crashed.log";
+    removeStore(log);
+    removeStore(crashed);
+
+    KVStoreOptions options;
+    options.backgroundThreads = false;
+    options.deltaSnapshotsPerFull = 2;
+    {
+        auto store = KVStore::create(log, options);
+        for (int i = 0; i < 100; ++i) {
+            store->put("key" + std::to_string(i), std::string(100, 'a'));
+        }
+        store->runSnapshot();
+        EXPECT_EQ(deltaCount(log), 0u);
+        auto fullSize = std::filesystem::file_size(log + ".snapshot");
+
+        store->put("key1", "changed");
+        store->remove("key2");
+        store->runSnapshot();
+        ASSERT_EQ(deltaCount(log), 1u);
+        for (const auto& file : storeFiles(log)) {
+            if (file.find(".delta.") != std::string::npos) {
+                EXPECT_LT(std::filesystem::file_size(file), fullSize / 10);
+            }
+        }
+
+        store->runSnapshot(); // Nothing changed, nothing written
+        EXPECT_EQ(deltaCount(log), 1u);
+
+        store->put("key3", "expiring", 60000);
+        store->runSnapshot();
+        EXPECT_EQ(deltaCount(log), 2u);
+        copyStore(log, crashed);
+
+        store->put("key4", "consolidated");
+        store->runSnapshot();
+        EXPECT_EQ(deltaCount(log), 0u);
+    }
+
+    auto recovered = KVStore::create(crashed, options);
+    EXPECT_EQ(recovered->getRecoveryStats().deltaSnapshots, 2u);
+    EXPECT_EQ(recovered->getRecoveryStats().walRecords, 0u);
+    EXPECT_EQ(recovered->get("key1"), "changed");
+    EXPECT_FALSE(recovered->get("key2").has_value());
+    EXPECT_EQ(recovered->get("key3"), "expiring");
+    EXPECT_EQ(recovered->get("key4"), std::string(100, 'a'));
+    recovered.reset();
+
+    removeStore(log);
+    removeStore(crashed);
+}
+
+// TTLs are persisted as wall-clock deadlines: keys that expired while the
+// store was down come back neither from the snapshot nor from the log, and
+// live ones keep their TTL
+TEST(KVStoreTest, TTLSurvivesRestart) {
+    const std::string log = "test_ttl_restart.log";
+    const std::string crashed = "test_ttl_crashed.log";
+    removeStore(log);
+    removeStore(crashed);
+
+    KVStoreOptions options;
+    options.backgroundThreads = false;
+    {
+        auto store = KVStore::create(log, options);
+        store->put("short", "gone", 300, Durability::Sync);
+        store->put("long", "kept", 60000, Durability::Sync);
+        store->put("shadowed", "old", Durability::Sync);
+        store->put("shadowed", "new", 300, Durability::Sync);
+        copyStore(log, crashed); // Log only; shutdown writes the snapshot
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+
+    auto fromSnapshot = KVStore::create(log, options);
+    EXPECT_EQ(fromSnapshot->getRecoveryStats().snapshotEntries, 1u);
+    auto fromLog = KVStore::create(crashed, options);
+    for (auto* store : {fromSnapshot.get(), fromLog.get()}) {
+        EXPECT_FALSE(store->get("short").has_value());
+        EXPECT_FALSE(store->get("shadowed").has_value());
+        EXPECT_EQ(store->get("long"), "kept");
+    }
+    fromSnapshot.reset();
+    fromLog.reset();
+
+    removeStore(log);
+    removeStore(crashed);
+}
+
+TEST(KVStoreTest, SampledExpiry) {
+    const std::string log = "test_sampled_expiry.log";
+    removeStore(log);
+    {
+        KVStoreOptions options;
+        options.backgroundThreads = false;
+        options.expiryMode = ExpiryMode::Sampled;
+        auto store = KVStore::create(log, options);
+        for (int i = 0; i < 1000; ++i) {
+            store->put("short_" + std::to_string(i), "value", 50);
+        }
+        for (int i = 0; i < 100; ++i) {
+            store->put("kept_" + std::to_string(i), "value");
+            store->put("long_" + std::to_string(i), "value", 3600 * 1000);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        EXPECT_FALSE(store->get("short_0").has_value());
+
+        store->runCleanup();
+        auto stats = store->getExpiryStats();
+        EXPECT_EQ(stats.cycles, 1u);
+        EXPECT_GT(stats.keysProbed, 0u);
+        EXPECT_GT(stats.keysExpired, 0u);
+        EXPECT_GT(stats.expiredKeysEstimate, 0u);
+        EXPECT_GT(stats.expiredBytesEstimate, 0u);
+
+        // Each cycle keeps sampling while most probes hit expired keys; the
+        // last few stragglers take a number of cycles to be drawn
+        for (int i = 0; i < 2000 && store->getExpiryStats().keysExpired < 1000; ++i) {
+            store->runCleanup();
+        }
+        EXPECT_EQ(store->getExpiryStats().keysExpired, 1000u);
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_TRUE(store->get("kept_" + std::to_string(i)).has_value());
+            EXPECT_TRUE(store->get("long_" + std::to_string(i)).has_value());
+        }
+    }
+    removeStore(log);
+}
+
+// Gets that run beside writers overwriting, removing and growing the same
+// keys only ever see a whole value that was written
+TEST(KVStoreTest, ReadsDuringWritesSeeWholeValues) {
+    KVStore store;
+    const int keys = 2000;
+    auto keyFor = [](int i) { return "key_" + std::to_string(i); };
+    // Lengths either side of 255 switch the entry between its two layouts
+    auto valueFor = [&keyFor](int i, int round) { return keyFor(i) + ":" + std::string(round % 400, 'x'); };
+
+    std::atomic<bool> done{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&, t] {
+            for (int i = t; !done; i = (i + 7) % keys) {
+                auto value = store.get(keyFor(i));
+                if (!value) continue;
+                std::string prefix = keyFor(i) + ":";
+                if (value->compare(0, prefix.size(), prefix) != 0 ||
+                    value->find_first_not_of('x', prefix.size()) != std::string::npos) {
+                    ++torn;
+                }
+            }
+        });
+    }
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < keys; ++i) {
+            if ((i + round) % 5 == 0) {
+                store.remove(keyFor(i));
+            } else {
+                store.put(keyFor(i), valueFor(i, round * 37 + i));
+            }
+        }
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(store.get(keyFor(2)), valueFor(2, 19 * 37 + 2));
+}
+
+// Keys can be views into larger buffers; only the viewed bytes count
+TEST(KVStoreTest, StringViewKeys) {
+    KVStore store;
+    std::string buffer = "user:42|user:43";
+    std::string_view first = std::string_view(buffer).substr(0, 7);
+    std::string_view second = std::string_view(buffer).substr(8, 7);
+    store.put(first, "alice");
+    store.put(second, std::string_view(buffer).substr(0, 4));
+    EXPECT_EQ(store.get("user:42"), "alice");
+    EXPECT_EQ(store.get(second), "user");
+    store.remove(first);
+    EXPECT_FALSE(store.get(std::string("user:42")).has_value());
+}
@@ -154,6 +154,36 @@ TEST_F(PartitionedKVStoreTest, PartitionIsolation) {
     EXPECT_TRUE(store.get("partition_test_4").has_value());
 }
 
+// Each partition counts its own entries' memory
+TEST_F(PartitionedKVStoreTest, MemoryPerPartition) {
+    PartitionedKVStore store(4);
+    for (int i = 0; i < 1000; ++i) {
+        store.put("memory_key_" + std::to_string(i), "value");
+    }
+
+    size_t sum = 0;
+    for (size_t i = 0; i < store.getPartitionCount(); ++i) {
+        size_t used = store.getPartitionMemoryStats(i).bytesUsed;
+        EXPECT_GT(used, 0u);
+        sum += used;
+    }
+    EXPECT_EQ(store.getMemoryStats().bytesUsed, sum);
+}
+
+// The memory limit is shared out over the partitions
+TEST_F(PartitionedKVStoreTest, MemoryLimit) {
+    KVStoreOptions options;
+    options.maxMemoryBytes = 512 * 1024;
+    PartitionedKVStore store(4, options);
+    for (int i = 0; i < 20000; ++i) {
+        store.put("limit_key_" + std::to_string(i), std::string(50, 'v'));
+    }
+    auto stats = store.getMemoryStats();
+    EXPECT_LE(stats.bytesUsed, options.maxMemoryBytes);
+    EXPECT_GT(stats.keysEvicted, 0u);
+    EXPECT_TRUE(store.get("limit_key_19999").has_value());
+}
+
 // Test TTL functionality across partitions
 TEST_F(PartitionedKVStoreTest, TTLAcrossPartitions) {
     PartitionedKVStore store(8);
@@ -293,3 +323,43 @@ TEST_F(PartitionedKVStoreTest, HashDistributionQuality) {
     // Should retrieve all inserted keys
     EXPECT_EQ(retrieved_count, num_keys);
 }
+
+// Partitions recovered in parallel see everything written before the restart
+TEST_F(PartitionedKVStoreTest, ParallelRecovery) {
+    // Segments, snapshots and delta snapshots of the first partitions
+    auto removePartitionFiles = [] {
+        for (int i = 0; i < 4; ++i) {
+            std::string prefix = "WAL_partition_" + std::to_string(i) + ".log";
+            WriteAheadLog::removeLog(prefix);
+            for (const auto& entry : std::filesystem::directory_iterator(".")) {
+                if (entry.path().filename().string().rfind(prefix + ".snapshot", 0) == 0) {
+                    std::filesystem::remove(entry.path());
+                }
+            }
+        }
+    };
+    removePartitionFiles();
+
+    const int num_keys = 400;
+    {
+        PartitionedKVStore store(4);
+        for (int i = 0; i < num_keys; ++i) {
+            store.put("recovery_key_" + std::to_string(i), "value_" + std::to_string(i));
+        }
+    }
+
+    {
+        PartitionedKVStore store(4, {}, WALWriterPool::DEFAULT_THREADS, 4);
+        for (int i = 0; i < num_keys; ++i) {
+            auto value = store.get("recovery_key_" + std::to_string(i));
+            ASSERT_TRUE(value.has_value());
+            EXPECT_EQ(value.value(), "value_" + std::to_string(i));
+        }
+        // Shutdown snapshotted every partition, so nothing is left to replay
+        auto stats = store.getRecoveryStats();
+        EXPECT_EQ(stats.snapshotEntries, static_cast<size_t>(num_keys));
+        EXPECT_EQ(stats.walRecords, 0u);
+        EXPECT_GT(store.getRecoveryTime().count(), 0);
+    }
+    removePartitionFiles();
+}
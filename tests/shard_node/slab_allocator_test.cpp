@@ -0,0 +1,88 @@
+#include "../../shard_node/slab_allocator.hpp"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Block {
+    void* data;
+    size_t bytes;
+};
+
+} // namespace
+
+TEST(SlabAllocatorTest, CountsBytesExactly) {
+    auto slabs = SlabAllocator::create();
+    void* small = slabs->allocate(45, 0);
+    void* shared = slabs->allocate(30, 100000);
+    void* large = slabs->allocate(SlabAllocator::MAX_BLOCK + 1, 0);
+    EXPECT_EQ(slabs->getBytesUsed(), 45 + 30 + 100000 + SlabAllocator::MAX_BLOCK + 1);
+    EXPECT_EQ(slabs->getSlabBytes(), 2 * SlabAllocator::SLAB_SIZE); // The 48 and 32 byte classes
+
+    SlabAllocator::deallocate(small, 45, 0);
+    SlabAllocator::deallocate(shared, 30, 100000);
+    SlabAllocator::deallocate(large, SlabAllocator::MAX_BLOCK + 1, 0);
+    EXPECT_EQ(slabs->getBytesUsed(), 0);
+}
+
+TEST(SlabAllocatorTest, BlocksDontOverlap) {
+    auto slabs = SlabAllocator::create();
+    std::vector<Block> blocks;
+    for (size_t i = 0; i < 20000; ++i) {
+        size_t bytes = 1 + (i * 37) % SlabAllocator::MAX_BLOCK;
+        blocks.push_back({slabs->allocate(bytes, 0), bytes});
+        std::memset(blocks.back().data, static_cast<int>(i & 0xFF), bytes);
+    }
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        auto* p = static_cast<unsigned char*>(blocks[i].data);
+        ASSERT_EQ(p[0], i & 0xFF);
+        ASSERT_EQ(p[blocks[i].bytes - 1], i & 0xFF);
+    }
+    for (const auto& block : blocks) SlabAllocator::deallocate(block.data, block.bytes, 0);
+    EXPECT_EQ(slabs->getBytesUsed(), 0);
+}
+
+// Moving blocks out of the slabs compaction marks lets them be unmapped
+TEST(SlabAllocatorTest, CompactionEmptiesSparseSlabs) {
+    auto slabs = SlabAllocator::create();
+    std::vector<Block> blocks;
+    for (size_t i = 0; i < 40000; ++i) blocks.push_back({slabs->allocate(64, 0), 64});
+    size_t mapped = slabs->getSlabBytes();
+    EXPECT_GE(mapped, 9 * SlabAllocator::SLAB_SIZE);
+
+    // Keep every tenth block
+    std::vector<Block> kept;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (i % 10 == 0) {
+            kept.push_back(blocks[i]);
+        } else {
+            SlabAllocator::deallocate(blocks[i].data, 64, 0);
+        }
+    }
+    EXPECT_EQ(slabs->getSlabBytes(), mapped);
+    EXPECT_GT(slabs->getFragmentation(), 0.8);
+
+    EXPECT_GT(slabs->beginCompaction(), 0u);
+    for (auto& block : kept) {
+        if (!SlabAllocator::isEvacuating(block.data, 64)) continue;
+        void* moved = slabs->allocate(64, 0);
+        EXPECT_FALSE(SlabAllocator::isEvacuating(moved, 64));
+        SlabAllocator::deallocate(block.data, 64, 0);
+        block.data = moved;
+    }
+    EXPECT_EQ(slabs->getSlabBytes(), SlabAllocator::SLAB_SIZE);
+    EXPECT_EQ(slabs->getBytesUsed(), kept.size() * 64);
+    for (const auto& block : kept) SlabAllocator::deallocate(block.data, 64, 0);
+}
+
+// Blocks freed after the owner lets go, as deferred frees are, still go
+// back to their slab
+TEST(SlabAllocatorTest, OutlivesHandle) {
+    auto slabs = SlabAllocator::create();
+    void* small = slabs->allocate(100, 0);
+    void* large = slabs->allocate(2 * SlabAllocator::MAX_BLOCK, 0);
+    slabs.reset();
+    SlabAllocator::deallocate(small, 100, 0);
+    SlabAllocator::deallocate(large, 2 * SlabAllocator::MAX_BLOCK, 0);
+}
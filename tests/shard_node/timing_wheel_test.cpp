@@ -0,0 +1,94 @@
+#include "../../shard_node/timing_wheel.hpp"
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+std::vector<std::string> collect(TimingWheel& wheel, TimingWheel::Clock::time_point now, size_t limit = 100) {
+    std::vector<TimingWheel::Entry> due;
+    wheel.collectDue(now, due, limit);
+    std::vector<std::string> keys;
+    for (const auto& entry : due) keys.push_back(entry.key);
+    return keys;
+}
+
+} // namespace
+
+// Entries come due at their deadline, never before, from every level
+TEST(TimingWheelTest, CollectsEntriesAtTheirDeadline) {
+    auto t0 = TimingWheel::Clock::now();
+    TimingWheel wheel(t0);
+    wheel.schedule("soon", t0 + 5ms);
+    wheel.schedule("later", t0 + 300ms);      // Second level
+    wheel.schedule("minutes", t0 + 70s);      // Third level
+    wheel.schedule("hours", t0 + 5h);         // Fourth level
+    wheel.schedule("past", t0 - 1s);
+    EXPECT_EQ(wheel.size(), 5u);
+
+    EXPECT_EQ(collect(wheel, t0), std::vector<std::string>{"past"});
+    EXPECT_TRUE(collect(wheel, t0 + 4ms).empty());
+    EXPECT_EQ(collect(wheel, t0 + 5ms), std::vector<std::string>{"soon"});
+    EXPECT_TRUE(collect(wheel, t0 + 299ms).empty());
+    EXPECT_EQ(collect(wheel, t0 + 300ms), std::vector<std::string>{"later"});
+    EXPECT_TRUE(collect(wheel, t0 + 70s - 1ms).empty());
+    EXPECT_EQ(collect(wheel, t0 + 70s), std::vector<std::string>{"minutes"});
+    EXPECT_TRUE(collect(wheel, t0 + 5h - 1ms).empty());
+    EXPECT_EQ(collect(wheel, t0 + 5h), std::vector<std::string>{"hours"});
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+// A deadline inside a tick is only collected once the whole tick has passed
+TEST(TimingWheelTest, RoundsDeadlinesUp) {
+    auto t0 = TimingWheel::Clock::now();
+    TimingWheel wheel(t0);
+    wheel.schedule("key", t0 + 2500us);
+    EXPECT_TRUE(collect(wheel, t0 + 2999us).empty());
+    EXPECT_EQ(collect(wheel, t0 + 3ms), std::vector<std::string>{"key"});
+}
+
+// Due entries beyond the batch limit wait for the next call
+TEST(TimingWheelTest, HandsOutBoundedBatches) {
+    auto t0 = TimingWheel::Clock::now();
+    TimingWheel wheel(t0);
+    for (int i = 0; i < 10; ++i) {
+        wheel.schedule("key" + std::to_string(i), t0 + std::chrono::milliseconds(1 + i % 3));
+    }
+    EXPECT_EQ(collect(wheel, t0 + 10ms, 4).size(), 4u);
+    EXPECT_EQ(collect(wheel, t0 + 10ms, 4).size(), 4u);
+    EXPECT_EQ(collect(wheel, t0 + 10ms, 4).size(), 2u);
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+// Scheduling a key again moves its one entry, earlier or later
+TEST(TimingWheelTest, ReschedulingMovesTheEntry) {
+    auto t0 = TimingWheel::Clock::now();
+    TimingWheel wheel(t0);
+    wheel.schedule("key", t0 + 10ms);
+    size_t bytes = wheel.memoryBytes();
+    for (int i = 0; i < 1000; ++i) wheel.schedule("key", t0 + 400ms + std::chrono::milliseconds(i));
+    EXPECT_EQ(wheel.size(), 1u);
+    EXPECT_EQ(wheel.memoryBytes(), bytes);
+    EXPECT_TRUE(collect(wheel, t0 + 500ms).empty());
+
+    wheel.schedule("key", t0 + 600ms); // Earlier than before
+    EXPECT_EQ(collect(wheel, t0 + 600ms), std::vector<std::string>{"key"});
+    EXPECT_TRUE(collect(wheel, t0 + 2s).empty());
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+// A cancelled key is never collected and gives its memory back
+TEST(TimingWheelTest, CancelDropsTheEntry) {
+    auto t0 = TimingWheel::Clock::now();
+    TimingWheel wheel(t0);
+    wheel.schedule("kept", t0 + 5ms);
+    wheel.schedule(std::string(100, 'x'), t0 + 5ms);
+    wheel.schedule("due", t0 - 1ms);
+    size_t full = wheel.memoryBytes();
+    wheel.cancel(std::string(100, 'x'));
+    wheel.cancel("due");
+    wheel.cancel("absent");
+    EXPECT_EQ(wheel.size(), 1u);
+    EXPECT_LT(wheel.memoryBytes(), full - 100);
+    EXPECT_EQ(collect(wheel, t0 + 5ms), std::vector<std::string>{"kept"});
+}
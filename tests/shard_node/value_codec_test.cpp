@@ -0,0 +1,61 @@
+#include "../../shard_node/value_codec.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+std::string repetitiveValue(size_t bytes) {
+    std::string value;
+    for (int i = 0; value.size() < bytes; ++i) value += "{\"key\":\"value_" + std::to_string(i % 50) + "\"},";
+    return value;
+}
+
+} // namespace
+
+TEST(ValueCodecTest, RoundTrips) {
+    std::string value = repetitiveValue(10000);
+    for (ValueCompression codec : {ValueCompression::LZ4, ValueCompression::Zstd}) {
+        SCOPED_TRACE(ValueCodec::name(codec));
+        auto stored = ValueCodec::compress(codec, value);
+        if (!ValueCodec::isAvailable(codec)) {
+            EXPECT_FALSE(stored.has_value());
+            continue;
+        }
+        ASSERT_TRUE(stored.has_value());
+        EXPECT_LT(stored->size(), value.size() / 4);
+        EXPECT_TRUE(ValueCodec::canDecompress(*stored));
+        EXPECT_EQ(ValueCodec::decompress(*stored), value);
+    }
+    EXPECT_FALSE(ValueCodec::compress(ValueCompression::None, value).has_value());
+}
+
+// Values that don't shrink by an eighth are left to be stored as they are
+TEST(ValueCodecTest, SkipsIncompressibleValues) {
+    std::string noise(4096, '\0');
+    std::mt19937 random(1);
+    for (char& c : noise) c = static_cast<char>(random());
+    EXPECT_FALSE(ValueCodec::compress(ValueCompression::LZ4, noise).has_value());
+    EXPECT_FALSE(ValueCodec::compress(ValueCompression::Zstd, noise).has_value());
+}
+
+TEST(ValueCodecTest, RejectsBadFrames) {
+    EXPECT_FALSE(ValueCodec::canDecompress(""));
+    EXPECT_THROW(ValueCodec::decompress(""), std::runtime_error);
+    // Codec None and an unknown codec
+    EXPECT_THROW(ValueCodec::decompress(std::string("\0\5hello", 7)), std::runtime_error);
+    EXPECT_THROW(ValueCodec::decompress(std::string("\x7F\5hello", 7)), std::runtime_error);
+
+    std::string value = repetitiveValue(10000);
+    for (ValueCompression codec : {ValueCompression::LZ4, ValueCompression::Zstd}) {
+        if (!ValueCodec::isAvailable(codec)) continue;
+        SCOPED_TRACE(ValueCodec::name(codec));
+        std::string stored = *ValueCodec::compress(codec, value);
+        EXPECT_THROW(ValueCodec::decompress(stored.substr(0, stored.size() / 2)), std::runtime_error);
+        // A raw size that doesn't match the data
+        std::string wrongSize = stored;
+        wrongSize[1] = static_cast<char>(wrongSize[1] ^ 1);
+        EXPECT_THROW(ValueCodec::decompress(wrongSize), std::runtime_error);
+    }
+}
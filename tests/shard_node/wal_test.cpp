@@ -1,6 +1,10 @@
 #include "../../shard_node/wal.hpp"
+#include "../../shard_node/crc32c.hpp"
+#include "../../shard_node/wal_writer_pool.hpp"
 #include <gtest/gtest.h>
 #include <filesystem>
+#include <fstream>
+#include <mutex>
 #include <thread>
 #include <vector>
 #include <chrono>
@@ -9,30 +13,98 @@ class WALTest : public ::testing::Test {
 protected:
     void SetUp() override {
         test_file_ = "test_wal_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".log";
-        // Clean up any existing test file
-        std::filesystem::remove(test_file_);
+        // Clean up any existing test log
+        WriteAheadLog::removeLog(test_file_);
     }
 
     void TearDown() override {
-        // Clean up test file
-        std::filesystem::remove(test_file_);
+        // Clean up test log
+        WriteAheadLog::removeLog(test_file_);
+    }
+
+    std::vector<std::string> readKeys() {
+        std::vector<std::string> keys;
+        WriteAheadLog::replay(test_file_, [&keys](const WALRecord& record) {
+            keys.emplace_back(record.key);
+        });
+        return keys;
+    }
+
+    // Newest segment of the test log
+    std::string segmentFile() {
+        return WriteAheadLog::listSegments(test_file_).back();
     }
 
     std::string test_file_;
 };
 
+static std::string putRecord(const std::string& key, const std::string& value) {
+    return WriteAheadLog::encodeRecord(WALOp::Put, key, value);
+}
+
+// Records are written in sequence order even when submitted out of order
+TEST_F(WALTest, OutOfOrderSubmitKeepsSequenceOrder) {
+    WriteAheadLog wal(test_file_);
+    auto first = wal.reserveSequence();
+    auto second = wal.reserveSequence();
+    wal.submit(second, putRecord("second", "v"));
+    wal.submit(first, putRecord("first", "v"));
+    wal.flush();
+
+    EXPECT_EQ(readKeys(), (std::vector<std::string>{"first", "second"}));
+}
+
+// As KVStore uses it: sequences are reserved under a lock and the records
+// submitted after it is released, in whatever order the threads get there.
+// Each record still lands at the LSN it reserved, with none missing.
+TEST_F(WALTest, SubmitAfterReserveUnderLock) {
+    const int num_threads = 8;
+    const int writes_per_thread = 200;
+    {
+        WriteAheadLog wal(test_file_);
+        std::mutex lock;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&wal, &lock, t, writes_per_thread]() {
+                for (int i = 0; i < writes_per_thread; ++i) {
+                    uint64_t sequence;
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        sequence = wal.reserveSequence();
+                    }
+                    // Let other threads overtake this one now and then
+                    if ((i + t) % 7 == 0) std::this_thread::yield();
+                    wal.submit(sequence, putRecord(std::to_string(sequence), "v"));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        wal.flush();
+    }
+
+    uint64_t expected = 1;
+    WriteAheadLog::replay(test_file_, [&expected](const WALRecord& record) {
+        EXPECT_EQ(record.lsn, expected);
+        EXPECT_EQ(record.key, std::to_string(record.lsn));
+        ++expected;
+    });
+    EXPECT_EQ(expected, static_cast<uint64_t>(num_threads * writes_per_thread) + 1);
+}
+
 // Test basic WAL operations
 TEST_F(WALTest, BasicWriteAndFlush) {
     WriteAheadLog wal(test_file_);
     
     // Test basic append
-    wal.append("PUT key1 value1");
-    wal.append("PUT key2 value2");
+    wal.append(putRecord("key1", "value1"));
+    wal.append(putRecord("key2", "value2"));
     wal.flush();
     
-    // Verify file exists and has content
-    EXPECT_TRUE(std::filesystem::exists(test_file_));
-    EXPECT_GT(std::filesystem::file_size(test_file_), 0);
+    // Verify the segment exists and has content
+    ASSERT_EQ(WriteAheadLog::listSegments(test_file_).size(), 1);
+    EXPECT_GT(std::filesystem::file_size(segmentFile()), WriteAheadLog::HEADER_SIZE);
 }
 
 // Test batch writing functionality
@@ -41,21 +113,18 @@ TEST_F(WALTest, BatchWriting) {
     
     // Add multiple entries without explicit flush
     for (int i = 0; i < 10; ++i) {
-        wal.append("PUT key" + std::to_string(i) + " value" + std::to_string(i));
+        wal.append(putRecord("key" + std::to_string(i), "value" + std::to_string(i)));
     }
     
     // Batch should be written automatically or on flush
     wal.flush();
     
     // Verify all entries are written
-    std::ifstream file(test_file_);
-    std::string line;
-    int count = 0;
-    while (std::getline(file, line)) {
-        EXPECT_TRUE(line.find("PUT key") != std::string::npos);
-        count++;
+    auto keys = readKeys();
+    ASSERT_EQ(keys.size(), 10);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(keys[i], "key" + std::to_string(i));
     }
-    EXPECT_EQ(count, 10);
 }
 
 // Test concurrent WAL writes
@@ -69,7 +138,7 @@ TEST_F(WALTest, ConcurrentWrites) {
     for (int t = 0; t < num_threads; ++t) {
         threads.emplace_back([&wal, t, writes_per_thread]() {
             for (int i = 0; i < writes_per_thread; ++i) {
-                wal.append("PUT thread" + std::to_string(t) + "_key" + std::to_string(i) + " value");
+                wal.append(putRecord("thread" + std::to_string(t) + "_key" + std::to_string(i), "value"));
             }
         });
     }
@@ -82,13 +151,7 @@ TEST_F(WALTest, ConcurrentWrites) {
     wal.flush();
     
     // Verify total number of entries
-    std::ifstream file(test_file_);
-    std::string line;
-    int count = 0;
-    while (std::getline(file, line)) {
-        count++;
-    }
-    EXPECT_EQ(count, num_threads * writes_per_thread);
+    EXPECT_EQ(readKeys().size(), num_threads * writes_per_thread);
 }
 
 // Test WAL reset functionality
@@ -96,19 +159,23 @@ TEST_F(WALTest, ResetWAL) {
     WriteAheadLog wal(test_file_);
     
     // Write some data
-    wal.append("PUT key1 value1");
-    wal.append("PUT key2 value2");
+    wal.append(putRecord("key1", "value1"));
+    wal.append(putRecord("key2", "value2"));
     wal.flush();
     
     // Verify file has content
-    EXPECT_GT(std::filesystem::file_size(test_file_), 0);
+    EXPECT_GT(std::filesystem::file_size(segmentFile()), WriteAheadLog::HEADER_SIZE);
     
     // Reset WAL
     wal.reset();
     
-    // Verify file is empty or recreated
-    EXPECT_TRUE(std::filesystem::exists(test_file_));
-    EXPECT_EQ(std::filesystem::file_size(test_file_), 0);
+    // Verify the log is left with only an empty segment
+    ASSERT_EQ(WriteAheadLog::listSegments(test_file_).size(), 1);
+    EXPECT_TRUE(readKeys().empty());
+
+    // Appends continue from the start of the segment
+    wal.append(putRecord("key3", "value3"));
+    EXPECT_EQ(readKeys(), (std::vector<std::string>{"key3"}));
 }
 
 // Test WAL with large batch sizes
@@ -118,19 +185,13 @@ TEST_F(WALTest, LargeBatchSize) {
     // Write a large number of entries to test batch behavior
     const int large_count = 1000;
     for (int i = 0; i < large_count; ++i) {
-        wal.append("PUT large_key_" + std::to_string(i) + " large_value_" + std::to_string(i));
+        wal.append(putRecord("large_key_" + std::to_string(i), "large_value_" + std::to_string(i)));
     }
     
     wal.flush();
     
     // Verify all entries are written
-    std::ifstream file(test_file_);
-    std::string line;
-    int count = 0;
-    while (std::getline(file, line)) {
-        count++;
-    }
-    EXPECT_EQ(count, large_count);
+    EXPECT_EQ(readKeys().size(), large_count);
 }
 
 // Test WAL file operations edge cases
@@ -147,25 +208,58 @@ TEST_F(WALTest, VariousEntryTypes) {
     WriteAheadLog wal(test_file_);
     
     // Test different operation types
-    wal.append("PUT key1 value1");
-    wal.append("REMOVE key2");
-    wal.append("PUT key3 value_with_spaces");
-    wal.append("PUT key4 value\nwith\nnewlines");
+    wal.append(putRecord("key1", "value1"));
+    wal.append(WriteAheadLog::encodeRecord(WALOp::Remove, "key2"));
+    wal.append(putRecord("key3", "value with spaces"));
+    wal.append(putRecord("key4", "value\nwith\nnewlines"));
+    wal.append(WriteAheadLog::encodeRecord(WALOp::Put, "key5", std::string("bin\0ary", 7), 12345));
     
     wal.flush();
     
-    // Verify all entries are written
-    std::ifstream file(test_file_);
-    std::string line;
-    std::vector<std::string> lines;
-    while (std::getline(file, line)) {
-        lines.push_back(line);
-    }
+    // Verify all entries round-trip byte for byte
+    std::vector<WALOp> ops;
+    std::vector<std::string> keys, values;
+    std::vector<int64_t> expiries;
+    WriteAheadLog::replay(test_file_, [&](const WALRecord& record) {
+        ops.push_back(record.op);
+        keys.emplace_back(record.key);
+        values.emplace_back(record.value);
+        expiries.push_back(record.expiryMs);
+    });
     
-    EXPECT_EQ(lines.size(), 4);
-    EXPECT_TRUE(lines[0].find("PUT key1") != std::string::npos);
-    EXPECT_TRUE(lines[1].find("REMOVE key2") != std::string::npos);
-    EXPECT_TRUE(lines[2].find("PUT key3") != std::string::npos);
+    ASSERT_EQ(keys.size(), 5);
+    EXPECT_EQ(ops[0], WALOp::Put);
+    EXPECT_EQ(ops[1], WALOp::Remove);
+    EXPECT_EQ(keys[1], "key2");
+    EXPECT_EQ(values[2], "value with spaces");
+    EXPECT_EQ(values[3], "value\nwith\nnewlines");
+    EXPECT_EQ(values[4], std::string("bin\0ary", 7));
+    EXPECT_EQ(expiries[4], 12345);
+}
+
+// A record whose value stays in a shared buffer is written and checksummed
+// as if it had been copied in
+TEST_F(WALTest, SharedValueRecord) {
+    SharedValue value(std::string(10000, 'v'));
+    {
+        WriteAheadLog wal(test_file_);
+        wal.appendBatch(putRecord("before", "x"));
+        wal.appendBatch(WriteAheadLog::encodeRecord(WALOp::Put, "shared", value, 777));
+        wal.waitFor(wal.appendBatch(putRecord("after", "y")), Durability::Sync);
+    }
+
+    std::vector<std::string> keys, values;
+    std::vector<int64_t> expiries;
+    WriteAheadLog::replay(test_file_, [&](const WALRecord& record) {
+        keys.emplace_back(record.key);
+        values.emplace_back(record.value);
+        expiries.push_back(record.expiryMs);
+    });
+    ASSERT_EQ(keys.size(), 3u);
+    EXPECT_EQ(keys[1], "shared");
+    EXPECT_EQ(values[1], value.view());
+    EXPECT_EQ(expiries[1], 777);
+    EXPECT_EQ(values[2], "y");
 }
 
 // Test WAL performance under stress
@@ -177,7 +271,7 @@ TEST_F(WALTest, StressTest) {
     // High-frequency writes
     const int stress_count = 10000;
     for (int i = 0; i < stress_count; ++i) {
-        wal.append("PUT stress_key_" + std::to_string(i) + " stress_value_" + std::to_string(i));
+        wal.append(putRecord("stress_key_" + std::to_string(i), "stress_value_" + std::to_string(i)));
     }
     
     wal.flush();
@@ -189,11 +283,367 @@ TEST_F(WALTest, StressTest) {
     EXPECT_LT(duration.count(), 5000); // 5 seconds max
     
     // Verify all entries written
-    std::ifstream file(test_file_);
-    std::string line;
-    int count = 0;
-    while (std::getline(file, line)) {
-        count++;
+    EXPECT_EQ(readKeys().size(), stress_count);
+}
+
+// A record cut short by a crash must stop replay and be truncated away
+TEST_F(WALTest, TornTailIsTruncated) {
+    {
+        WriteAheadLog wal(test_file_);
+        wal.append(putRecord("key1", "value1"));
+        wal.append(putRecord("key2", "value2"));
+        wal.flush();
+    }
+    auto intactSize = std::filesystem::file_size(segmentFile());
+
+    // Simulate a crash halfway through writing a third record
+    std::string partial = putRecord("key3", "value3");
+    {
+        std::ofstream out(segmentFile(), std::ios::app | std::ios::binary);
+        out.write(partial.data(), static_cast<std::streamsize>(partial.size() / 2));
+    }
+
+    std::vector<std::string> keys;
+    auto result = WriteAheadLog::replay(test_file_, [&keys](const WALRecord& record) {
+        keys.emplace_back(record.key);
+    });
+    EXPECT_TRUE(result.tornTail);
+    EXPECT_EQ(result.records, 2);
+    EXPECT_EQ(keys, (std::vector<std::string>{"key1", "key2"}));
+    EXPECT_EQ(std::filesystem::file_size(segmentFile()), intactSize);
+
+    // Appends after recovery land on a clean record boundary
+    {
+        WriteAheadLog wal(test_file_);
+        wal.append(putRecord("key4", "value4"));
+        wal.flush();
+    }
+    EXPECT_EQ(readKeys(), (std::vector<std::string>{"key1", "key2", "key4"}));
+}
+
+// A flipped byte fails the record CRC and ends replay at that record
+TEST_F(WALTest, CorruptRecordStopsReplay) {
+    {
+        WriteAheadLog wal(test_file_);
+        wal.append(putRecord("key1", "value1"));
+        wal.append(putRecord("key2", "value2"));
+        wal.flush();
+    }
+    {
+        std::fstream file(segmentFile(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put('X');
+    }
+
+    auto result = WriteAheadLog::replay(test_file_, [](const WALRecord&) {});
+    EXPECT_TRUE(result.tornTail);
+    EXPECT_EQ(result.records, 1);
+}
+
+TEST(CRC32CTest, KnownVector) {
+    // Standard CRC32C check value
+    EXPECT_EQ(crc32c("123456789", 9), 0xE3069283u);
+    // Extending over split buffers matches a single pass
+    EXPECT_EQ(crc32c("6789", 4, crc32c("12345", 5)), 0xE3069283u);
+}
+
+// A Sync append is on disk when appendBatch/waitFor returns, without flush()
+TEST_F(WALTest, SyncDurabilityBeforeAck) {
+    WriteAheadLog wal(test_file_);
+    wal.waitFor(wal.appendBatch(putRecord("durable", "value")), Durability::Sync);
+
+    EXPECT_EQ(readKeys(), (std::vector<std::string>{"durable"}));
+    EXPECT_GE(wal.getSyncCount(), 1);
+}
+
+// Concurrent Sync writers are committed in groups that share one fdatasync
+TEST_F(WALTest, GroupCommitSharesSync) {
+    WriteAheadLog wal(test_file_);
+    const int num_threads = 8;
+    const int writes_per_thread = 50;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&wal, t, writes_per_thread]() {
+            for (int i = 0; i < writes_per_thread; ++i) {
+                auto sequence = wal.appendBatch(putRecord("t" + std::to_string(t) + "_" + std::to_string(i), "v"));
+                wal.waitFor(sequence, Durability::Sync);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(readKeys().size(), num_threads * writes_per_thread);
+    EXPECT_LE(wal.getSyncCount(), static_cast<uint64_t>(num_threads * writes_per_thread));
+    EXPECT_GE(wal.getSyncCount(), 1);
+}
+
+// A full ring blocks producers instead of growing without bound
+TEST_F(WALTest, RingBackpressure) {
+    WriteAheadLog wal(test_file_, WALOptions{.ringCapacity = 8});
+    const int num_threads = 4;
+    const int writes_per_thread = 500;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&wal, t, writes_per_thread]() {
+            for (int i = 0; i < writes_per_thread; ++i) {
+                wal.appendBatch(putRecord(std::to_string(t) + "_" + std::to_string(i), "v"));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    wal.flush();
+
+    // Every record arrives and each producer's records keep their order
+    auto keys = readKeys();
+    ASSERT_EQ(keys.size(), num_threads * writes_per_thread);
+    std::vector<int> next(num_threads, 0);
+    for (const auto& key : keys) {
+        int t = std::stoi(key.substr(0, key.find('_')));
+        EXPECT_EQ(key, std::to_string(t) + "_" + std::to_string(next[t]++));
+    }
+    EXPECT_GT(wal.getBackpressureWaits(), 0);
+}
+
+// Many logs can share a couple of writer threads, and idle logs don't wake them
+TEST_F(WALTest, SharedWriterPool) {
+    const int num_logs = 16;
+    WALWriterPool pool(2);
+    std::vector<std::string> files;
+    {
+        std::vector<std::unique_ptr<WriteAheadLog>> wals;
+        for (int i = 0; i < num_logs; ++i) {
+            files.push_back(test_file_ + "_" + std::to_string(i));
+            WriteAheadLog::removeLog(files.back());
+            wals.push_back(std::make_unique<WriteAheadLog>(files.back(), WALOptions{.writerPool = &pool}));
+        }
+        for (int i = 0; i < num_logs; ++i) {
+            wals[i]->append(putRecord("key" + std::to_string(i), "v"));
+        }
+        auto seq = wals[0]->appendBatch(putRecord("synced", "v"));
+        wals[0]->waitFor(seq, Durability::Sync);
+        EXPECT_EQ(wals[0]->getSyncCount(), 1);
+
+        auto idleStart = pool.getWakeupCount();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        EXPECT_LE(pool.getWakeupCount() - idleStart, 2);
     }
-    EXPECT_EQ(count, stress_count);
+
+    for (int i = 0; i < num_logs; ++i) {
+        std::vector<std::string> keys;
+        WriteAheadLog::replay(files[i], [&keys](const WALRecord& record) {
+            keys.emplace_back(record.key);
+        });
+        std::vector<std::string> expected{"key" + std::to_string(i)};
+        if (i == 0) expected.push_back("synced");
+        EXPECT_EQ(keys, expected);
+        WriteAheadLog::removeLog(files[i]);
+    }
+}
+
+// The io_uring engine (or its pwrite fallback) produces the same log,
+// including batches larger than its staging buffer and after a reset
+TEST_F(WALTest, IOUringEngine) {
+    const int num_records = 400;
+    const std::string value(8192, 'v');
+    {
+        WriteAheadLog wal(test_file_, WALOptions{.ioEngine = WALIOEngine::IOUring});
+        wal.append(putRecord("before_reset", "v"));
+        wal.reset();
+
+        uint64_t seq = 0;
+        for (int i = 0; i < num_records; ++i) {
+            seq = wal.appendBatch(putRecord("key" + std::to_string(i), value));
+        }
+        wal.waitFor(seq, Durability::Sync);
+        EXPECT_GT(wal.getIOSyscallCount(), 0);
+    }
+
+    size_t count = 0;
+    WriteAheadLog::replay(test_file_, [&](const WALRecord& record) {
+        EXPECT_EQ(record.key, "key" + std::to_string(count));
+        EXPECT_EQ(record.value, value);
+        ++count;
+    });
+    EXPECT_EQ(count, num_records);
+}
+
+// Records spread over fixed-size segments; LSNs carry on across reopen and
+// segments covered by a checkpoint are deleted
+TEST_F(WALTest, SegmentRotationAndRetirement) {
+    const WALOptions options{.segmentSize = 512};
+    const int num_records = 200;
+    {
+        WriteAheadLog wal(test_file_, options);
+        for (int i = 0; i < num_records / 2; ++i) {
+            wal.appendBatch(putRecord("key" + std::to_string(i), "value"));
+        }
+        wal.flush();
+    }
+    {
+        WriteAheadLog wal(test_file_, options);
+        EXPECT_EQ(wal.getLastLSN(), num_records / 2);
+        for (int i = num_records / 2; i < num_records; ++i) {
+            wal.appendBatch(putRecord("key" + std::to_string(i), "value"));
+        }
+        wal.flush();
+        EXPECT_GT(wal.getSegmentCount(), 5);
+
+        std::vector<uint64_t> lsns;
+        auto result = WriteAheadLog::replay(test_file_, [&lsns](const WALRecord& record) {
+            lsns.push_back(record.lsn);
+        });
+        ASSERT_EQ(lsns.size(), num_records);
+        for (size_t i = 0; i < lsns.size(); ++i) {
+            EXPECT_EQ(lsns[i], i + 1);
+        }
+        EXPECT_EQ(result.lastLSN, num_records);
+
+        // Replay past a checkpoint only returns newer records
+        std::vector<uint64_t> newer;
+        WriteAheadLog::replay(test_file_, [&newer](const WALRecord& record) {
+            newer.push_back(record.lsn);
+        }, 150);
+        EXPECT_EQ(newer.size(), 50);
+        EXPECT_EQ(newer.front(), 151);
+
+        // Retiring keeps every segment that still holds an LSN above 150
+        size_t before = wal.getSegmentCount();
+        EXPECT_GT(wal.retireSegments(150), 0);
+        EXPECT_EQ(wal.getSegmentCount(), WriteAheadLog::listSegments(test_file_).size());
+        EXPECT_LT(wal.getSegmentCount(), before);
+    }
+    std::vector<uint64_t> remaining;
+    WriteAheadLog::replay(test_file_, [&remaining](const WALRecord& record) {
+        remaining.push_back(record.lsn);
+    }, 150);
+    EXPECT_EQ(remaining.size(), 50);
+}
+
+// Retired segments are reused for new ones, and whatever a reused file held
+// before is never replayed
+TEST_F(WALTest, RecycledSegments) {
+    const WALOptions options{.segmentSize = 512, .recycledSegments = 2};
+    {
+        WriteAheadLog wal(test_file_, options);
+        for (int i = 0; i < 100; ++i) {
+            wal.appendBatch(putRecord("old" + std::to_string(i), "value"));
+        }
+        wal.flush();
+        wal.retireSegments(wal.getLastLSN());
+
+        for (int i = 0; i < 20; ++i) {
+            wal.appendBatch(putRecord("new" + std::to_string(i), "v"));
+        }
+        wal.flush();
+        EXPECT_GT(wal.getRecycleCount(), 0);
+    }
+
+    size_t spares = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(".")) {
+        if (entry.path().filename().string().rfind(test_file_ + ".spare.", 0) == 0) ++spares;
+    }
+    EXPECT_LE(spares, 2);
+
+    std::vector<std::string> keys;
+    auto result = WriteAheadLog::replay(test_file_, [&keys](const WALRecord& record) {
+        keys.emplace_back(record.key);
+    }, 100);
+    EXPECT_FALSE(result.tornTail);
+    ASSERT_EQ(keys.size(), 20);
+    EXPECT_EQ(keys.front(), "new0");
+    EXPECT_EQ(keys.back(), "new19");
+    EXPECT_EQ(result.lastLSN, 120);
+}
+
+// Copies a log's segments as a crash would leave them: a clean shutdown
+// trims the newest segment, a crash doesn't
+static void crashCopy(const std::string& log, const std::string& copy) {
+    WriteAheadLog::removeLog(copy);
+    for (const auto& segment : WriteAheadLog::listSegments(log)) {
+        std::filesystem::copy_file(segment, copy + segment.substr(log.size()));
+    }
+}
+
+// A reused segment still holds its old records past the new ones; crashing
+// and restarting must not mistake them for a torn tail, however often
+TEST_F(WALTest, RecycledSegmentTailIsNotTorn) {
+    const WALOptions options{.segmentSize = 4096, .recycledSegments = 2};
+    const std::string crashed[2] = {test_file_ + ".crashed0", test_file_ + ".crashed1"};
+    {
+        WriteAheadLog wal(test_file_, options);
+        for (int i = 0; i < 200; ++i) {
+            wal.appendBatch(putRecord("old" + std::to_string(i), std::string(100, 'o')));
+        }
+        wal.flush();
+        wal.retireSegments(wal.getLastLSN());
+        // Roll into a reused segment and stop well short of filling it
+        for (int i = 0; i < 50; ++i) {
+            wal.appendBatch(putRecord("new" + std::to_string(i), std::string(100, 'n')));
+        }
+        wal.flush();
+        ASSERT_GT(wal.getRecycleCount(), 0);
+        crashCopy(test_file_, crashed[0]);
+    }
+
+    for (int restart = 0; restart < 3; ++restart) {
+        const std::string& log = crashed[restart % 2];
+        auto newest = WriteAheadLog::listSegments(log).back();
+        auto size = std::filesystem::file_size(newest);
+
+        testing::internal::CaptureStderr();
+        auto result = WriteAheadLog::replay(log, [](const WALRecord&) {}, 200);
+        std::string output = testing::internal::GetCapturedStderr();
+        EXPECT_FALSE(result.tornTail);
+        EXPECT_EQ(output.find("Discarding"), std::string::npos) << output;
+        EXPECT_EQ(std::filesystem::file_size(newest), size);
+        EXPECT_EQ(result.records, 50 + static_cast<size_t>(restart));
+        EXPECT_EQ(result.lastLSN, 250 + static_cast<uint64_t>(restart));
+
+        WriteAheadLog wal(log, options, &result);
+        wal.append(putRecord("restart" + std::to_string(restart), "v"));
+        crashCopy(log, crashed[(restart + 1) % 2]);
+    }
+    WriteAheadLog::removeLog(crashed[0]);
+    WriteAheadLog::removeLog(crashed[1]);
+}
+
+// Segments are reserved a chunk at a time just ahead of the appends, and
+// recovery trims what a crash left reserved without mistaking it for a
+// torn tail
+TEST_F(WALTest, PreallocationStaysAheadOfAppends) {
+    const WALOptions options;
+    const std::string crashed = test_file_ + ".crashed";
+    size_t written = WriteAheadLog::HEADER_SIZE;
+    {
+        WriteAheadLog wal(test_file_, options);
+        EXPECT_EQ(std::filesystem::file_size(segmentFile()), WriteAheadLog::HEADER_SIZE);
+
+        // Records straddling the chunks recovery reads in
+        for (int i = 0; i < 40; ++i) {
+            std::string record = putRecord("key" + std::to_string(i), std::string(100000 + i, 'v'));
+            written += record.size();
+            wal.appendBatch(record);
+        }
+        wal.flush();
+        auto size = std::filesystem::file_size(segmentFile());
+        EXPECT_GT(size, written);
+        EXPECT_LE(size, written + options.preallocateChunk);
+        crashCopy(test_file_, crashed);
+    }
+
+    testing::internal::CaptureStderr();
+    auto result = WriteAheadLog::replay(crashed, [](const WALRecord&) {});
+    std::string output = testing::internal::GetCapturedStderr();
+    EXPECT_FALSE(result.tornTail);
+    EXPECT_EQ(output.find("Discarding"), std::string::npos) << output;
+    EXPECT_EQ(result.records, 40);
+    EXPECT_EQ(result.endOffset, written);
+    EXPECT_EQ(std::filesystem::file_size(WriteAheadLog::listSegments(crashed).back()), written);
+    WriteAheadLog::removeLog(crashed);
 }